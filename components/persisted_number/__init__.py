@@ -12,10 +12,29 @@ PersistedNumber = number.number_ns.class_(
     "PersistedNumber", number.Number, cg.Component
 )
 
+CONF_MAX_SAVE_DELAY = "max_save_delay"
+CONF_MIN_SAVE_INTERVAL = "min_save_interval"
+
+
+def validate_save_delays(config: OrderedDict):
+    if CONF_MAX_SAVE_DELAY not in config:
+        config[CONF_MAX_SAVE_DELAY] = config[CONF_MIN_SAVE_INTERVAL]
+    if config[CONF_MAX_SAVE_DELAY] < config[CONF_MIN_SAVE_INTERVAL]:
+        raise cv.Invalid(
+            f"{CONF_MAX_SAVE_DELAY} must not be shorter than {CONF_MIN_SAVE_INTERVAL}"
+        )
+    return config
+
+
+# Combine with validate_save_delays, once the schema is extended
 PERSISTED_NUMBER_SCHEMA = number.NUMBER_SCHEMA.extend(
     {
         cv.GenerateID(): cv.declare_id(PersistedNumber),
         cv.Optional(CONF_RESTORE_VALUE, default=True): cv.boolean,
+        cv.Optional(
+            CONF_MIN_SAVE_INTERVAL, default="0s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_MAX_SAVE_DELAY): cv.positive_time_period_milliseconds,
     }
 )
 
@@ -32,4 +51,6 @@ async def new_persisted_number(
     await cg.register_component(var, config)
     if CONF_RESTORE_VALUE in config:
         cg.add(var.set_restore_value(config[CONF_RESTORE_VALUE]))
+    cg.add(var.set_min_save_interval(config[CONF_MIN_SAVE_INTERVAL]))
+    cg.add(var.set_max_save_delay(config[CONF_MAX_SAVE_DELAY]))
     return var
@@ -1,14 +1,67 @@
 #include "persisted_number.h"
+#include "esphome/core/hal.h"
 #include "esphome/core/log.h"
 
 namespace esphome {
 namespace number {
 
+auto PersistedNumber::dump_config() -> void {
+  if (!this->restore_value_) {
+    return;
+  }
+  ESP_LOGCONFIG("number", "'%s': Saving at most every %ums, within %ums of a change", this->get_name().c_str(),
+                (unsigned) this->min_save_interval_, (unsigned) this->max_save_delay_);
+}
+
 auto PersistedNumber::control(float newValue) -> void {
   this->publish_state(newValue);
-  if (this->restore_value_) {
-    this->pref_.save(&newValue);
+  if (!this->restore_value_) {
+    return;
+  }
+  auto now = millis();
+  if (!this->dirty_) {
+    this->dirty_since_ = now;
+  }
+  this->dirty_ = true;
+  this->last_change_ = now;
+  if (this->min_save_interval_ == 0) {
+    this->save();
+  }
+}
+
+auto PersistedNumber::loop() -> void {
+  if (!this->dirty_) {
+    return;
+  }
+  auto now = millis();
+  if (now - this->last_save_ < this->min_save_interval_) {
+    return;
+  }
+  // Wait for a burst of changes to settle, but not longer than the maximum delay
+  if (now - this->last_change_ >= this->min_save_interval_ || now - this->dirty_since_ >= this->max_save_delay_) {
+    this->save();
+  }
+}
+
+auto PersistedNumber::save() -> void {
+  if (!this->dirty_) {
+    return;
+  }
+  float value = this->state;
+  if (!this->pref_.save(&value)) {
+    ESP_LOGW("number", "'%s': Failed to save state %f", this->get_name().c_str(), value);
+  }
+  this->dirty_ = false;
+  this->last_save_ = millis();
+}
+
+auto PersistedNumber::on_shutdown() -> void {
+  if (!this->dirty_) {
+    return;
   }
+  this->save();
+  // The preferences may commit before this saved, so the change is committed here, once per reboot
+  global_preferences->sync();
 }
 
 auto PersistedNumber::setup() -> void {
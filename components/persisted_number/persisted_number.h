@@ -7,17 +7,36 @@
 namespace esphome {
 namespace number {
 
+/**
+ * A number which is restored on boot. Each change is saved right away, unless `min_save_interval` is set: then a
+ * burst of changes is saved once it settles, at most once per interval and at the latest `max_save_delay` after the
+ * first unsaved change. Saved changes are committed to flash by the preferences, on their `flash_write_interval`.
+ */
 class PersistedNumber : public number::Number, public Component {
  public:
   float get_setup_priority() const override { return setup_priority::HARDWARE; }
   void set_restore_value(bool restore) { this->restore_value_ = restore; }
+  void set_min_save_interval(uint32_t interval) { this->min_save_interval_ = interval; }
+  void set_max_save_delay(uint32_t delay) { this->max_save_delay_ = delay; }
   void setup() override;
+  void loop() override;
+  void dump_config() override;
+  /** Saves & commits an unsaved change before rebooting, e.g. for an OTA update */
+  void on_shutdown() override;
 
  protected:
   void control(float value) override;
+  /** Hands the state over to the preferences, if it changed since it was last saved */
+  void save();
 
   bool restore_value_{false};
   ESPPreferenceObject pref_;
+  bool dirty_{false};
+  uint32_t min_save_interval_{0};
+  uint32_t max_save_delay_{0};
+  uint32_t last_save_{0};
+  uint32_t last_change_{0};
+  uint32_t dirty_since_{0};
 };
 
 }  // namespace number
@@ -1,34 +1,76 @@
 from typing import Dict, Union
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
 from esphome.const import (
     CONF_HEIGHT,
+    CONF_I2C_ID,
     CONF_ID,
     CONF_INVERT,
     CONF_SENSOR,
     CONF_WIDTH,
 )
-from ..vl53l1x import distance_as_mm, NullableSchema, VL53L1X
+from ..tof_sensor import RANGING_MODES, TofSensor
+from ..vl53l1x import distance_as_mm, NullableSchema
 
-DEPENDENCIES = ["vl53l1x"]
-AUTO_LOAD = ["vl53l1x", "sensor", "binary_sensor", "text_sensor", "number"]
+AUTO_LOAD = ["tof_sensor", "sensor", "binary_sensor", "text_sensor", "number"]
 MULTI_CONF = True
 
 CONF_ROODE_ID = "roode_id"
 
 roode_ns = cg.esphome_ns.namespace("roode")
 Roode = roode_ns.class_("Roode", cg.PollingComponent)
+MinFilter = roode_ns.class_("MinFilter")
+MedianFilter = roode_ns.class_("MedianFilter")
+ExponentialMovingAverageFilter = roode_ns.class_("ExponentialMovingAverageFilter")
+HampelFilter = roode_ns.class_("HampelFilter")
+GateAction = roode_ns.enum("GateAction", is_class=True)
+GATE_ACTIONS = {
+    "keep": GateAction.Keep,
+    "down_weight": GateAction.DownWeight,
+    "drop": GateAction.Drop,
+}
 
+CONF_ACTIVE_TIMEOUT = "active_timeout"
+CONF_ADAPTIVE_RANGING = "adaptive_ranging"
 CONF_AUTO = "auto"
+CONF_IDLE_INTERVAL = "idle_interval"
+CONF_IDLE_RANGING = "idle_ranging"
+CONF_LANES = "lanes"
 CONF_ORIENTATION = "orientation"
+CONF_PERSIST_CALIBRATION = "persist_calibration"
 CONF_DETECTION_THRESHOLDS = "detection_thresholds"
+CONF_DROP_INVALID = "drop_invalid"
+CONF_DWELL_TIMEOUT = "dwell_timeout"
+CONF_EVENT_BUFFER_SIZE = "event_buffer_size"
+CONF_EXPONENTIAL_MOVING_AVERAGE = "exponential_moving_average"
+CONF_FILTERS = "filters"
+CONF_HAMPEL = "hampel"
+CONF_HOMEASSISTANT_EVENTS = "homeassistant_events"
+CONF_MEDIAN = "median"
+CONF_MIDDLE_ZONES = "middle"
+CONF_THRESHOLD = "threshold"
+CONF_WINDOW = "window"
 CONF_ENTRY_ZONE = "entry"
 CONF_EXIT_ZONE = "exit"
+CONF_CALIBRATION_REJECT_OUTLIERS = "calibration_reject_outliers"
+CONF_CALIBRATION_SAMPLES = "calibration_samples"
 CONF_CENTER = "center"
 CONF_MAX = "max"
+CONF_MAX_AMBIENT_RATE = "max_ambient_rate"
 CONF_MIN = "min"
+CONF_MIN_SIGNAL_RATE = "min_signal_rate"
+CONF_PATH = "path"
+CONF_QUALITY_GATE = "quality_gate"
+CONF_READS = "reads"
 CONF_ROI = "roi"
+CONF_ROI_SEARCH = "roi_search"
 CONF_SAMPLING = "sampling"
+CONF_SENSOR_TASK = "sensor_task"
+CONF_SIGMA_FAIL = "sigma_fail"
+CONF_TRACE_SIZE = "trace_size"
+CONF_WAKE_ON_DISTANCE = "wake_on_distance"
+CONF_ZONE = "zone"
 CONF_ZONES = "zones"
 
 Orientation = roode_ns.enum("Orientation")
@@ -59,32 +101,177 @@ THRESHOLDS_SCHEMA = NullableSchema(
     }
 )
 
+filter_window = cv.int_range(min=1, max=255)
+
+FILTER_SCHEMA = cv.Any(
+    cv.Schema({cv.Required(CONF_MIN): filter_window}),
+    cv.Schema({cv.Required(CONF_MEDIAN): filter_window}),
+    cv.Schema(
+        {
+            cv.Required(CONF_EXPONENTIAL_MOVING_AVERAGE): cv.float_range(
+                min=0, min_included=False, max=1
+            )
+        }
+    ),
+    cv.Schema(
+        {
+            cv.Required(CONF_HAMPEL): NullableSchema(
+                {
+                    cv.Optional(CONF_WINDOW, default=7): cv.int_range(min=3, max=255),
+                    cv.Optional(CONF_THRESHOLD, default=3.0): cv.positive_float,
+                }
+            )
+        }
+    ),
+)
+
+FILTERS_SCHEMA = cv.ensure_list(FILTER_SCHEMA)
+
+# Rates in kcps, 0 disables the limit
+QUALITY_GATE_SCHEMA = NullableSchema(
+    {
+        cv.Optional(CONF_DROP_INVALID): cv.boolean,
+        cv.Optional(CONF_SIGMA_FAIL): cv.enum(GATE_ACTIONS),
+        cv.Optional(CONF_MIN_SIGNAL_RATE): cv.uint32_t,
+        cv.Optional(CONF_MAX_AMBIENT_RATE): cv.uint32_t,
+    }
+)
+
 ZONE_SCHEMA = NullableSchema(
     {
         cv.Optional(CONF_ROI, default={}): ROI_SCHEMA,
         cv.Optional(CONF_DETECTION_THRESHOLDS, default={}): THRESHOLDS_SCHEMA,
+        cv.Optional(CONF_FILTERS): FILTERS_SCHEMA,
+        cv.Optional(CONF_QUALITY_GATE, default={}): QUALITY_GATE_SCHEMA,
     }
 )
 
+def validate_zone_layout(config: Dict):
+    # At most 4 zones: a row of up to 4, or 2 lanes of an entry & exit zone
+    if config[CONF_LANES] > 1 and config[CONF_MIDDLE_ZONES]:
+        raise cv.Invalid(f"{CONF_MIDDLE_ZONES} zones can only be used with a single lane")
+    if config[CONF_LANES] > 1:
+        # Both lanes use these zone configs, a center would put their zones on the same SPADs
+        for key in (CONF_ENTRY_ZONE, CONF_EXIT_ZONE):
+            roi = config[key].get(CONF_ROI, {})
+            if isinstance(roi, dict) and CONF_CENTER in roi:
+                raise cv.Invalid(
+                    f"The {CONF_CENTER} of the ROI cannot be set with multiple lanes, which are placed side by side",
+                    path=[key, CONF_ROI, CONF_CENTER],
+                )
+    return config
+
+
 CONFIG_SCHEMA = cv.Schema(
     {
         cv.GenerateID(): cv.declare_id(Roode),
-        cv.GenerateID(CONF_SENSOR): cv.use_id(VL53L1X),
+        cv.GenerateID(CONF_SENSOR): cv.use_id(TofSensor),
         cv.Optional(CONF_ORIENTATION, default="parallel"): cv.enum(ORIENTATION_VALUES),
         cv.Optional(CONF_SAMPLING, default=2): cv.All(cv.uint8_t, cv.Range(min=1)),
+        cv.Optional(CONF_TRACE_SIZE, default=0): cv.int_range(min=0, max=4096),
+        cv.Optional(CONF_SENSOR_TASK): cv.All(cv.boolean, cv.only_on_esp32),
+        cv.Optional(CONF_EVENT_BUFFER_SIZE, default=32): cv.int_range(min=1, max=1024),
+        cv.Optional(CONF_HOMEASSISTANT_EVENTS): cv.All(
+            cv.boolean, cv.requires_component("api")
+        ),
+        cv.Optional(CONF_PERSIST_CALIBRATION, default=False): cv.boolean,
+        cv.Optional(CONF_CALIBRATION_SAMPLES, default=20): cv.int_range(
+            min=5, max=1000
+        ),
+        cv.Optional(CONF_CALIBRATION_REJECT_OUTLIERS, default=True): cv.boolean,
         cv.Optional(CONF_ROI, default={}): ROI_SCHEMA,
+        cv.Optional(CONF_ROI_SEARCH): NullableSchema(
+            {cv.Optional(CONF_READS, default=10): cv.int_range(min=3, max=50)}
+        ),
         cv.Optional(CONF_DETECTION_THRESHOLDS, default={}): THRESHOLDS_SCHEMA,
-        cv.Optional(CONF_ZONES, default={}): NullableSchema(
+        cv.Optional(CONF_FILTERS): FILTERS_SCHEMA,
+        cv.Optional(CONF_QUALITY_GATE, default={}): QUALITY_GATE_SCHEMA,
+        cv.Optional(CONF_ADAPTIVE_RANGING): NullableSchema(
+            {
+                cv.Optional(CONF_IDLE_RANGING, default="longest"): cv.enum(
+                    {k: v for k, v in RANGING_MODES.items() if k != CONF_AUTO}
+                ),
+                cv.Optional(CONF_IDLE_INTERVAL): cv.All(
+                    cv.positive_time_period_milliseconds,
+                    cv.Range(max=cv.TimePeriod(milliseconds=65535)),
+                ),
+                cv.Optional(
+                    CONF_ACTIVE_TIMEOUT, default="5s"
+                ): cv.positive_time_period_milliseconds,
+                cv.Optional(CONF_WAKE_ON_DISTANCE, default=False): cv.boolean,
+            }
+        ),
+        # How long a zone may stay occupied before it is blocked, and a path may stall before it starts over.
+        # Both are off unless configured.
+        cv.Optional(CONF_DWELL_TIMEOUT): NullableSchema(
             {
-                cv.Optional(CONF_INVERT, default=False): cv.boolean,
-                cv.Optional(CONF_ENTRY_ZONE, default={}): ZONE_SCHEMA,
-                cv.Optional(CONF_EXIT_ZONE, default={}): ZONE_SCHEMA,
+                cv.Optional(
+                    CONF_ZONE, default="0s"
+                ): cv.positive_time_period_milliseconds,
+                cv.Optional(
+                    CONF_PATH, default="0s"
+                ): cv.positive_time_period_milliseconds,
             }
         ),
+        cv.Optional(CONF_ZONES, default={}): cv.All(
+            NullableSchema(
+                {
+                    cv.Optional(CONF_INVERT, default=False): cv.boolean,
+                    cv.Optional(CONF_ENTRY_ZONE, default={}): ZONE_SCHEMA,
+                    cv.Optional(CONF_EXIT_ZONE, default={}): ZONE_SCHEMA,
+                    cv.Optional(CONF_MIDDLE_ZONES, default=[]): cv.All(
+                        cv.ensure_list(ZONE_SCHEMA), cv.Length(max=2)
+                    ),
+                    cv.Optional(CONF_LANES, default=1): cv.int_range(min=1, max=2),
+                }
+            ),
+            validate_zone_layout,
+        ),
     }
 ).extend(cv.COMPONENT_SCHEMA)
 
 
+def validate_sensor_task(config: Dict):
+    """
+    The sensor task reads the sensor outside of the loop, while the I2C bus has no lock. So nothing else may use
+    the sensor or its bus: another Roode, another sensor or any other I2C device.
+    """
+    if not config.get(CONF_SENSOR_TASK, False):
+        return config
+    full_config = fv.full_config.get()
+    sensor_id = config[CONF_SENSOR].id
+    if any(
+        other[CONF_SENSOR].id == sensor_id and other[CONF_ID].id != config[CONF_ID].id
+        for other in full_config.get("roode", [])
+    ):
+        raise cv.Invalid(
+            "sensor_task requires the sensor not to be shared with another roode",
+            path=[CONF_SENSOR_TASK],
+        )
+    sensor = next(
+        (s for s in full_config.get("vl53l1x", []) if s[CONF_ID].id == sensor_id),
+        None,
+    )
+    if sensor is None:
+        # Not on I2C, e.g. the simulator
+        return config
+    bus_id = sensor[CONF_I2C_ID].id
+    for domain, domain_config in full_config.items():
+        for device in domain_config if isinstance(domain_config, list) else [domain_config]:
+            if device is sensor or not isinstance(device, dict):
+                continue
+            if CONF_I2C_ID in device and device[CONF_I2C_ID].id == bus_id:
+                raise cv.Invalid(
+                    f"sensor_task requires the sensor to be alone on its I2C bus, but {domain} uses it too. "
+                    "Move the other device to an I2C bus of its own.",
+                    path=[CONF_SENSOR_TASK],
+                )
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = validate_sensor_task
+
+
 async def to_code(config: Dict):
     roode = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(roode, config)
@@ -93,16 +280,49 @@ async def to_code(config: Dict):
     cg.add(roode.set_tof_sensor(sens))
 
     cg.add(roode.set_orientation(config[CONF_ORIENTATION]))
-    cg.add(roode.set_sampling_size(config[CONF_SAMPLING]))
+    if config[CONF_TRACE_SIZE] > 0:
+        cg.add(roode.set_trace_size(config[CONF_TRACE_SIZE]))
+    if config.get(CONF_SENSOR_TASK, False):
+        cg.add_define("USE_ROODE_SENSOR_TASK")
+        cg.add(roode.set_sensor_task(True))
+    cg.add(roode.set_event_buffer_size(config[CONF_EVENT_BUFFER_SIZE]))
+    if config.get(CONF_HOMEASSISTANT_EVENTS, False):
+        cg.add_define("USE_ROODE_CROSSING_EVENTS")
+        cg.add_define("USE_API_HOMEASSISTANT_SERVICES")
     cg.add(roode.set_invert_direction(config[CONF_ZONES][CONF_INVERT]))
-    setup_zone(CONF_ENTRY_ZONE, config, roode)
-    setup_zone(CONF_EXIT_ZONE, config, roode)
-
+    cg.add(roode.set_persist_calibration(config[CONF_PERSIST_CALIBRATION]))
+    cg.add(roode.set_calibration_samples(config[CONF_CALIBRATION_SAMPLES]))
+    cg.add(
+        roode.set_calibration_reject_outliers(config[CONF_CALIBRATION_REJECT_OUTLIERS])
+    )
+    if CONF_ROI_SEARCH in config:
+        cg.add(roode.set_roi_search(config[CONF_ROI_SEARCH][CONF_READS]))
+    if CONF_ADAPTIVE_RANGING in config:
+        adaptive = config[CONF_ADAPTIVE_RANGING]
+        interval = adaptive.get(CONF_IDLE_INTERVAL)
+        cg.add(
+            roode.set_idle_ranging_mode(
+                adaptive[CONF_IDLE_RANGING],
+                interval.total_milliseconds if interval is not None else 0,
+            )
+        )
+        cg.add(roode.set_active_timeout(adaptive[CONF_ACTIVE_TIMEOUT]))
+        cg.add(roode.set_distance_wake(adaptive[CONF_WAKE_ON_DISTANCE]))
+    if CONF_DWELL_TIMEOUT in config:
+        dwell = config[CONF_DWELL_TIMEOUT]
+        cg.add(roode.set_dwell_timeouts(dwell[CONF_ZONE], dwell[CONF_PATH]))
+    zones = config[CONF_ZONES]
+    middle = zones[CONF_MIDDLE_ZONES]
+    cg.add(roode.set_zone_layout(len(middle), zones[CONF_LANES]))
+    # Zones by id, like Roode::zones. The second lane's zones are configured like the first's.
+    zone_configs = [zones[CONF_ENTRY_ZONE], zones[CONF_EXIT_ZONE], *middle]
+    if zones[CONF_LANES] > 1:
+        zone_configs += [zones[CONF_ENTRY_ZONE], zones[CONF_EXIT_ZONE]]
+    for index, zone_config in enumerate(zone_configs):
+        setup_zone(zone_config, config, cg.MockObj(f"{roode}->zones[{index}]", "->"))
 
-def setup_zone(name: str, config: Dict, roode: cg.Pvariable):
-    zone_config = config[CONF_ZONES][name]
-    zone_var = cg.MockObj(f"{roode}->{name}", "->")
 
+def setup_zone(zone_config: Dict, config: Dict, zone_var: cg.MockObj):
     roi_var = cg.MockObj(f"{zone_var}->roi_override", "->")
     setup_roi(roi_var, zone_config.get(CONF_ROI, {}), config.get(CONF_ROI, {}))
 
@@ -113,6 +333,20 @@ def setup_zone(name: str, config: Dict, roode: cg.Pvariable):
         config.get(CONF_DETECTION_THRESHOLDS, {}),
     )
 
+    # Without any filters configured, the minimum over the sampling size is used
+    filters = zone_config.get(
+        CONF_FILTERS, config.get(CONF_FILTERS, [{CONF_MIN: config[CONF_SAMPLING]}])
+    )
+    for filter_config in filters:
+        cg.add(zone_var.add_filter(new_filter(filter_config)))
+
+    gate_var = cg.MockObj(f"{zone_var}->quality_gate", "->")
+    setup_quality_gate(
+        gate_var,
+        zone_config.get(CONF_QUALITY_GATE, {}),
+        config.get(CONF_QUALITY_GATE, {}),
+    )
+
 
 def setup_roi(var: cg.MockObj, config: Union[Dict, str], fallback: Union[Dict, str]):
     config: Dict = (
@@ -146,3 +380,30 @@ def setup_thresholds(var: cg.MockObj, config: Dict, fallback: Dict):
         cg.add(var.set_max_percentage(int(max * 100)))
     else:
         cg.add(var.set_max(max))
+
+
+def setup_quality_gate(var: cg.MockObj, config: Dict, fallback: Dict):
+    # Options of the zone override those for both zones, otherwise the defaults of QualityGate apply
+    config = {**(fallback or {}), **(config or {})}
+    if CONF_DROP_INVALID in config:
+        cg.add(var.set_drop_invalid(config[CONF_DROP_INVALID]))
+    if CONF_SIGMA_FAIL in config:
+        cg.add(var.set_sigma_fail(config[CONF_SIGMA_FAIL]))
+    if CONF_MIN_SIGNAL_RATE in config:
+        cg.add(var.set_min_signal_rate(config[CONF_MIN_SIGNAL_RATE]))
+    if CONF_MAX_AMBIENT_RATE in config:
+        cg.add(var.set_max_ambient_rate(config[CONF_MAX_AMBIENT_RATE]))
+
+
+def new_filter(config: Dict) -> cg.RawExpression:
+    if CONF_MIN in config:
+        return cg.RawExpression(f"new {MinFilter}({config[CONF_MIN]})")
+    if CONF_MEDIAN in config:
+        return cg.RawExpression(f"new {MedianFilter}({config[CONF_MEDIAN]})")
+    if CONF_EXPONENTIAL_MOVING_AVERAGE in config:
+        alpha = config[CONF_EXPONENTIAL_MOVING_AVERAGE]
+        return cg.RawExpression(f"new {ExponentialMovingAverageFilter}({alpha}f)")
+    hampel = config[CONF_HAMPEL]
+    return cg.RawExpression(
+        f"new {HampelFilter}({hampel[CONF_WINDOW]}, {hampel[CONF_THRESHOLD]}f)"
+    )
@@ -6,13 +6,17 @@ from esphome.const import (
     CONF_ID,
     CONF_DEVICE_CLASS,
     DEVICE_CLASS_OCCUPANCY,
+    DEVICE_CLASS_PROBLEM,
+    ENTITY_CATEGORY_DIAGNOSTIC,
 )
 from . import Roode, CONF_ROODE_ID
 
 DEPENDENCIES = ["roode"]
 
+CONF_MIN_PUBLISH_INTERVAL = "min_publish_interval"
 CONF_PRESENCE = "presence_sensor"
-TYPES = [CONF_PRESENCE]
+CONF_BLOCKED = "blocked_sensor"
+TYPES = [CONF_PRESENCE, CONF_BLOCKED]
 
 CONFIG_SCHEMA = cv.Schema(
     {
@@ -20,6 +24,22 @@ CONFIG_SCHEMA = cv.Schema(
         cv.Optional(CONF_PRESENCE): binary_sensor.BINARY_SENSOR_SCHEMA.extend(
             {
                 cv.GenerateID(): cv.declare_id(binary_sensor.BinarySensor),
+                # States are only published when they change, and at most once per this interval
+                cv.Optional(
+                    CONF_MIN_PUBLISH_INTERVAL
+                ): cv.positive_time_period_milliseconds,
+            }
+        ),
+        # On while a zone reads something which stayed in it as its background
+        cv.Optional(CONF_BLOCKED): binary_sensor.binary_sensor_schema(
+            device_class=DEVICE_CLASS_PROBLEM,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ).extend(
+            {
+                cv.GenerateID(): cv.declare_id(binary_sensor.BinarySensor),
+                cv.Optional(
+                    CONF_MIN_PUBLISH_INTERVAL
+                ): cv.positive_time_period_milliseconds,
             }
         ),
     }
@@ -46,7 +66,12 @@ async def setup_conf(config, key, hub):
         conf = config[key]
         sens = cg.new_Pvariable(conf[CONF_ID])
         await binary_sensor.register_binary_sensor(sens, conf)
-        cg.add(getattr(hub, f"set_{key}_binary_sensor")(sens))
+        interval = conf.get(CONF_MIN_PUBLISH_INTERVAL)
+        cg.add(
+            getattr(hub, f"set_{key}_binary_sensor")(
+                sens, interval.total_milliseconds if interval is not None else 0
+            )
+        )
 
 
 async def to_code(config):
@@ -0,0 +1,85 @@
+#include "calibration.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace roode {
+static const char *const ESTIMATOR = "Zone calibration";
+/** Reads further than this many standard deviations from the mean are outliers */
+static const float OUTLIER_DEVIATIONS = 3.0f;
+/** Smallest standard deviation in mm, so a quiet sensor does not reject its own noise */
+static const float MIN_DEVIATION = 15.0f;
+/** Converts the median absolute deviation to the standard deviation for normally distributed noise */
+static const float MAD_SCALE = 1.4826f;
+
+bool IdleEstimator::add(uint16_t distance) {
+  if (!this->reject_outliers) {
+    this->accept(distance);
+    return true;
+  }
+
+  if (this->seed_count < SEEDS) {
+    this->seeds[this->seed_count++] = distance;
+    if (this->seed_count < SEEDS) {
+      return true;
+    }
+    // Start from the seeds which are close to their median
+    std::sort(this->seeds, this->seeds + SEEDS);
+    uint16_t median = this->seeds[SEEDS / 2];
+    uint16_t deviations[SEEDS];
+    for (uint8_t i = 0; i < SEEDS; i++) {
+      deviations[i] = abs(this->seeds[i] - median);
+    }
+    std::sort(deviations, deviations + SEEDS);
+    float limit = OUTLIER_DEVIATIONS * std::max(deviations[SEEDS / 2] * MAD_SCALE, MIN_DEVIATION);
+    for (auto seed : this->seeds) {
+      if (fabsf((float) seed - median) <= limit) {
+        this->accept(seed);
+      } else {
+        this->rejected++;
+      }
+    }
+    return true;
+  }
+
+  float limit = OUTLIER_DEVIATIONS * std::max(this->standard_deviation(), MIN_DEVIATION);
+  if (fabsf(distance - this->mean_) > limit) {
+    ESP_LOGV(ESTIMATOR, "Rejected outlier: %d, mean: %.0f", distance, this->mean_);
+    this->rejected++;
+    return false;
+  }
+  this->accept(distance);
+  return true;
+}
+
+void IdleEstimator::accept(uint16_t distance) {
+  this->count++;
+  float delta = distance - this->mean_;
+  this->mean_ += delta / this->count;
+  this->m2 += delta * (distance - this->mean_);
+}
+
+float IdleEstimator::standard_deviation() const { return this->count > 0 ? sqrtf(this->m2 / this->count) : 0; }
+
+uint16_t IdleEstimator::idle() const {
+  float sd = this->standard_deviation();
+  ESP_LOGD(ESTIMATOR, "Zone AVG: %.0f", this->mean_);
+  ESP_LOGD(ESTIMATOR, "Zone SD: %.1f", sd);
+  if (this->rejected > 0) {
+    ESP_LOGD(ESTIMATOR, "Rejected outliers: %d", this->rejected);
+  }
+  return (uint16_t) std::max(this->mean_ - sd, 0.0f);
+}
+
+void IdleEstimator::reset() {
+  this->count = 0;
+  this->rejected = 0;
+  this->mean_ = 0;
+  this->m2 = 0;
+  this->seed_count = 0;
+}
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+
+namespace esphome {
+namespace roode {
+
+/** Zones of a Roode instance, e.g. two lanes of two zones or one lane of four */
+static const uint8_t MAX_ZONES = 4;
+
+/** The phases of calibrating the zones, one read at a time from the loop */
+enum class CalibrationState {
+  /** Not calibrating, the zones are counting */
+  Done,
+  /** Checking that the calibration restored from flash still matches the scene */
+  Validating,
+  /** Measuring the idle distances with the default ROIs, to choose the ranging mode */
+  Distance,
+  /** Measuring candidate ROIs, to find those with the steadiest idle distances furthest beyond the thresholds */
+  RoiSearch,
+  /** Measuring the idle distances with the calibrated ROIs, to set the thresholds */
+  Thresholds,
+};
+
+/**
+ * Estimates a zone's idle distance from its reads while calibrating, in O(1) memory.
+ * The mean and variance are updated per read with Welford's algorithm. With outlier rejection, reads too far from the
+ * mean, like those of someone walking through, are left out. The first reads are checked against their median and
+ * median absolute deviation instead, so an outlier among them does not skew the mean they start from.
+ */
+class IdleEstimator {
+ public:
+  void set_reject_outliers(bool reject) { this->reject_outliers = reject; }
+  /** Returns whether the distance was used */
+  bool add(uint16_t distance);
+  /** Number of reads used */
+  int get_count() const { return this->count; }
+  int get_rejected() const { return this->rejected; }
+  uint16_t mean() const { return (uint16_t) this->mean_; }
+  float standard_deviation() const;
+  /** The mean less one standard deviation */
+  uint16_t idle() const;
+  void reset();
+
+ protected:
+  void accept(uint16_t distance);
+  bool reject_outliers{true};
+  int count{0};
+  int rejected{0};
+  float mean_{0};
+  /** Sum of squared differences from the mean */
+  float m2{0};
+  static const uint8_t SEEDS = 3;
+  /** The first reads, until there are enough to take their median */
+  uint16_t seeds[SEEDS];
+  uint8_t seed_count{0};
+};
+
+/** A zone's calibration as saved to flash */
+struct ZoneCalibration {
+  uint16_t idle;
+  uint8_t roi_width;
+  uint8_t roi_height;
+  uint8_t roi_center;
+} __attribute__((packed));
+
+/** Calibration results as saved to flash, to skip calibrating on boot */
+struct CalibrationData {
+  /** Hash of the configuration the calibration was made with, it is discarded when that changes */
+  uint32_t config_hash;
+  /** Index of the ranging mode in CALIBRATION_RANGING_MODES */
+  uint8_t ranging_mode;
+  /** By zone id, unused ones are left empty */
+  ZoneCalibration zones[MAX_ZONES];
+} __attribute__((packed));
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace esphome {
+namespace roode {
+
+enum class Direction : int8_t { Exit = -1, Entry = 1 };
+
+/** An entry or exit, as it was detected */
+struct CrossingEvent {
+  /** millis() when the person left the zones */
+  uint32_t time;
+  Direction direction;
+  /** Share of the reads during the crossing which succeeded, in percent */
+  uint8_t confidence;
+  /** Walking speed between the outer zones, in mm/s, 0 when unknown */
+  uint16_t speed;
+};
+
+/**
+ * A fixed-size ring buffer, which one producer and one consumer can use concurrently without locks.
+ * Only the producer may push and only the consumer may pop, each of them owns one index.
+ * Memory is allocated once, when the capacity is set, which is rounded up to a power of two.
+ */
+template<typename T> class SpscRing {
+ public:
+  void set_capacity(uint16_t capacity) {
+    uint16_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    delete[] this->items;
+    this->items = new T[size];
+    this->mask = size - 1;
+    this->head.store(0, std::memory_order_relaxed);
+    this->tail.store(0, std::memory_order_relaxed);
+  }
+  uint16_t get_capacity() const { return this->items != nullptr ? this->mask + 1 : 0; }
+  uint32_t size() const {
+    return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire);
+  }
+  bool empty() const { return this->size() == 0; }
+
+  /** Returns false, without adding the item, when the ring is full */
+  bool push(const T &item) {
+    auto head = this->head.load(std::memory_order_relaxed);
+    if (this->items == nullptr || head - this->tail.load(std::memory_order_acquire) > this->mask) {
+      return false;
+    }
+    this->items[head & this->mask] = item;
+    // Publishes the item together with the new head
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+  /** The oldest item, which stays in the ring until it is popped. Only valid when not empty. */
+  const T &front() const { return this->items[this->tail.load(std::memory_order_relaxed) & this->mask]; }
+  /** Returns false when the ring is empty */
+  bool pop(T &item) {
+    auto tail = this->tail.load(std::memory_order_relaxed);
+    if (tail == this->head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = this->items[tail & this->mask];
+    // Frees the slot for the producer only after it was read
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+ protected:
+  T *items{nullptr};
+  uint16_t mask{0};
+  /** Free-running indices, the next item is pushed at head and popped at tail */
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,93 @@
+#include "filters.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace roode {
+static const char *const FILTER = "Filter";
+/** Converts the mean absolute deviation to the standard deviation for normally distributed noise, sqrt(pi / 2) */
+static const float MEAN_DEVIATION_SCALE = 1.2533f;
+/** Smallest deviation in mm, so identical distances do not make every change an outlier */
+static const float MIN_DEVIATION = 1.0f;
+
+uint16_t MinFilter::new_value(uint16_t distance) {
+  this->window.push(distance);
+  return this->window.min();
+}
+
+void MinFilter::dump_config() const { ESP_LOGCONFIG(FILTER, "       - Min: { window: %d }", this->window.get_capacity()); }
+
+MedianFilter::MedianFilter(uint8_t window) : window{std::max<uint8_t>(window, 1)} {
+  this->ring = new uint16_t[this->window];
+  this->sorted = new uint16_t[this->window];
+}
+
+MedianFilter::~MedianFilter() {
+  delete[] this->ring;
+  delete[] this->sorted;
+}
+
+uint16_t MedianFilter::new_value(uint16_t distance) {
+  if (this->count == this->window) {
+    // Drop the oldest distance, which is overwritten in the ring below
+    auto *oldest = std::lower_bound(this->sorted, this->sorted + this->count, this->ring[this->head]);
+    memmove(oldest, oldest + 1, (this->sorted + this->count - oldest - 1) * sizeof(uint16_t));
+    this->count--;
+  }
+  this->ring[this->head] = distance;
+  this->head = (this->head + 1) % this->window;
+
+  auto *position = std::upper_bound(this->sorted, this->sorted + this->count, distance);
+  memmove(position + 1, position, (this->sorted + this->count - position) * sizeof(uint16_t));
+  *position = distance;
+  this->count++;
+  return this->median();
+}
+
+uint16_t MedianFilter::median() const {
+  return (this->sorted[(this->count - 1) / 2] + this->sorted[this->count / 2]) / 2;
+}
+
+void MedianFilter::reset() {
+  this->head = 0;
+  this->count = 0;
+}
+
+void MedianFilter::dump_config() const { ESP_LOGCONFIG(FILTER, "       - Median: { window: %d }", this->window); }
+
+uint16_t ExponentialMovingAverageFilter::new_value(uint16_t distance) {
+  if (this->first) {
+    this->value = distance;
+    this->first = false;
+  } else {
+    this->value += this->alpha * (distance - this->value);
+  }
+  return (uint16_t) lroundf(this->value);
+}
+
+void ExponentialMovingAverageFilter::dump_config() const {
+  ESP_LOGCONFIG(FILTER, "       - Exponential moving average: { alpha: %.2f }", this->alpha);
+}
+
+uint16_t HampelFilter::new_value(uint16_t distance) {
+  auto median = this->median.new_value(distance);
+  float deviation = fabsf((float) distance - median);
+  float limit = this->threshold * MEAN_DEVIATION_SCALE * std::max(this->deviation, MIN_DEVIATION);
+  // Clipping lets the scale grow towards real noise, without single outliers inflating it
+  this->deviation += this->alpha * (std::min(deviation, limit) - this->deviation);
+  return deviation > limit ? median : distance;
+}
+
+void HampelFilter::reset() {
+  this->median.reset();
+  this->deviation = 0;
+}
+
+void HampelFilter::dump_config() const {
+  ESP_LOGCONFIG(FILTER, "       - Hampel: { window: %d, threshold: %.1f }", this->window, this->threshold);
+}
+
+}  // namespace roode
+}  // namespace esphome
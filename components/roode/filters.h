@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+
+#include "sliding_min.h"
+
+namespace esphome {
+namespace roode {
+
+/** A stage of a zone's filter chain, turning each measured distance into the distance used for path tracking */
+class DistanceFilter {
+ public:
+  virtual ~DistanceFilter() = default;
+  virtual uint16_t new_value(uint16_t distance) = 0;
+  /** Forgets all previous distances */
+  virtual void reset() = 0;
+  virtual void dump_config() const = 0;
+};
+
+/** Minimum of the last `window` distances. Low outliers pass through, but a person is never missed. */
+class MinFilter : public DistanceFilter {
+ public:
+  explicit MinFilter(uint8_t window) { this->window.set_capacity(window); }
+  uint16_t new_value(uint16_t distance) override;
+  void reset() override { this->window.clear(); }
+  void dump_config() const override;
+
+ protected:
+  SlidingMin window;
+};
+
+/**
+ * Median of the last `window` distances.
+ * Kept sorted with a binary search per sample, so the only linear cost is a memmove of at most `window` values.
+ */
+class MedianFilter : public DistanceFilter {
+ public:
+  explicit MedianFilter(uint8_t window);
+  MedianFilter(const MedianFilter &) = delete;
+  MedianFilter &operator=(const MedianFilter &) = delete;
+  ~MedianFilter() override;
+  uint16_t new_value(uint16_t distance) override;
+  void reset() override;
+  void dump_config() const override;
+  uint16_t median() const;
+
+ protected:
+  /** Distances in the order they were measured */
+  uint16_t *ring{nullptr};
+  /** The same distances in ascending order */
+  uint16_t *sorted{nullptr};
+  uint8_t window;
+  uint8_t head{0};
+  uint8_t count{0};
+};
+
+/** Exponential moving average, where `alpha` is the weight of the newest distance */
+class ExponentialMovingAverageFilter : public DistanceFilter {
+ public:
+  explicit ExponentialMovingAverageFilter(float alpha) : alpha{alpha} {}
+  uint16_t new_value(uint16_t distance) override;
+  void reset() override { this->first = true; }
+  void dump_config() const override;
+
+ protected:
+  float alpha;
+  float value{0};
+  bool first{true};
+};
+
+/**
+ * Replaces distances which are more than `threshold` standard deviations away from the median of the last `window`
+ * distances by that median. Others pass through unchanged, only replaced ones lag, by about half the window.
+ * The standard deviation is estimated in O(1) from a moving average of the absolute deviations from the median,
+ * clipped to the outlier limit, instead of from the median absolute deviation of the window.
+ */
+class HampelFilter : public DistanceFilter {
+ public:
+  HampelFilter(uint8_t window, float threshold)
+      : median(window), window{window}, threshold{threshold}, alpha{2.0f / (window + 1)} {}
+  uint16_t new_value(uint16_t distance) override;
+  void reset() override;
+  void dump_config() const override;
+
+ protected:
+  MedianFilter median;
+  uint8_t window;
+  float threshold;
+  float alpha;
+  float deviation{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,57 @@
+#include "instrumentation.h"
+#include <algorithm>
+
+namespace esphome {
+namespace roode {
+
+uint8_t LatencyHistogram::bucket(uint32_t duration) {
+  if (duration < 4) {
+    return duration;
+  }
+  // The highest bit picks the power of two, the two bits below it the quarter within it
+  uint8_t exponent = 31 - __builtin_clz(duration);
+  uint8_t quarter = (duration >> (exponent - 2)) & 0x3;
+  return std::min<uint32_t>((exponent - 1) * 4 + quarter, BUCKETS - 1);
+}
+
+uint32_t LatencyHistogram::upper_bound(uint8_t bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  uint8_t exponent = bucket / 4 + 1;
+  uint8_t quarter = bucket % 4;
+  return ((4u + quarter + 1) << (exponent - 2)) - 1;
+}
+
+void LatencyHistogram::record(uint32_t duration) {
+  auto &count = this->buckets[bucket(duration)];
+  if (count < UINT16_MAX) {
+    count++;
+  }
+  this->count++;
+  this->max = std::max(this->max, duration);
+}
+
+uint32_t LatencyHistogram::percentile(uint8_t percent) const {
+  if (this->count == 0) {
+    return 0;
+  }
+  uint32_t rank = std::max<uint32_t>(1, (uint64_t) this->count * percent / 100);
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < BUCKETS; i++) {
+    seen += this->buckets[i];
+    if (seen >= rank) {
+      return std::min(upper_bound(i), this->max);
+    }
+  }
+  return this->max;
+}
+
+void LatencyHistogram::reset() {
+  std::fill(this->buckets, this->buckets + BUCKETS, 0);
+  this->count = 0;
+  this->max = 0;
+}
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+
+#include "esphome/core/defines.h"
+
+namespace esphome {
+namespace roode {
+
+/** The timed stages of counting */
+enum class Stage : uint8_t {
+  /** Starting a measurement, which switches the ROI when ranging is restarted */
+  RoiSwitch,
+  /** From starting a measurement until its data is ready */
+  RangingWait,
+  /** Reading the result over I2C, which also programs the next ROI when ranging continuously */
+  ResultRead,
+  PathTracking,
+  /** Publishing the states of the sensors on update */
+  Publish,
+  /** From one zone's result being read to the next one's, its spread is the jitter of the sampling */
+  SampleInterval,
+};
+static const uint8_t STAGES = 6;
+
+enum class Statistic : uint8_t { P50, P99, Max };
+static const uint8_t STATISTICS = 3;
+
+/**
+ * Histogram of durations in microseconds, with four buckets per power of two.
+ * Recording is O(1) in a fixed 160 bytes, percentiles are within 25% of the actual durations.
+ */
+class LatencyHistogram {
+ public:
+  void record(uint32_t duration);
+  /** The duration which this percent of the recorded durations do not exceed, 0 when nothing was recorded */
+  uint32_t percentile(uint8_t percent) const;
+  uint32_t get_max() const { return this->max; }
+  uint32_t get_count() const { return this->count; }
+  void reset();
+
+ protected:
+  /** Durations of a second or longer share the last bucket */
+  static const uint8_t BUCKETS = 76;
+  static uint8_t bucket(uint32_t duration);
+  static uint32_t upper_bound(uint8_t bucket);
+  uint16_t buckets[BUCKETS]{};
+  uint32_t count{0};
+  uint32_t max{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -5,7 +5,11 @@ import esphome.config_validation as cv
 from esphome.const import CONF_ICON, CONF_MAX_VALUE
 from esphome.cpp_generator import MockObj
 
-from ..persisted_number import PERSISTED_NUMBER_SCHEMA, new_persisted_number
+from ..persisted_number import (
+    PERSISTED_NUMBER_SCHEMA,
+    new_persisted_number,
+    validate_save_delays,
+)
 from . import Roode, CONF_ROODE_ID
 
 DEPENDENCIES = ["roode"]
@@ -16,11 +20,14 @@ CONF_PEOPLE_COUNTER = "people_counter"
 CONFIG_SCHEMA = cv.Schema(
     {
         cv.GenerateID(CONF_ROODE_ID): cv.use_id(Roode),
-        cv.Optional(CONF_PEOPLE_COUNTER): PERSISTED_NUMBER_SCHEMA.extend(
-            {
-                cv.Optional(CONF_ICON, default="mdi:counter"): cv.icon,  # new default
-                cv.Optional(CONF_MAX_VALUE, 10): cv.int_range(-128, 128),
-            }
+        cv.Optional(CONF_PEOPLE_COUNTER): cv.All(
+            PERSISTED_NUMBER_SCHEMA.extend(
+                {
+                    cv.Optional(CONF_ICON, default="mdi:counter"): cv.icon,  # new default
+                    cv.Optional(CONF_MAX_VALUE, 10): cv.int_range(-128, 128),
+                }
+            ),
+            validate_save_delays,
         ),
     }
 )
@@ -0,0 +1,119 @@
+#include "path_tracker.h"
+#include "esphome/core/hal.h"
+
+namespace esphome {
+namespace roode {
+static const char *const TAG = "Roode";
+
+void PathTracker::set_zones(uint8_t zones) {
+  this->zones = zones < 2 ? 2 : (zones > MAX_PATH_ZONES ? MAX_PATH_ZONES : zones);
+  this->reset();
+}
+
+int PathTracker::update(uint8_t position, int CurrentZoneStatus) {
+  uint8_t bit = 1 << position;
+  uint8_t AllZonesCurrentStatus = CurrentZoneStatus == SOMEONE ? (this->status | bit) : (this->status & ~bit);
+  if (AllZonesCurrentStatus == this->status) {
+    return 0;
+  }
+  ESP_LOGD(TAG, "Event has occured, AllZonesCurrentStatus: %d", AllZonesCurrentStatus);
+  bool started = this->status == 0;
+  this->status = AllZonesCurrentStatus;
+  this->last_change = millis();
+
+  if (AllZonesCurrentStatus != 0) {
+    if (started) {
+      this->first_status = AllZonesCurrentStatus;
+      this->handoffs = 0;
+      this->entered_zones = 0;
+    }
+    if (CurrentZoneStatus == SOMEONE) {
+      this->occupied_since[position] = this->last_change;
+    }
+    if ((this->entered_zones & bit) == 0) {
+      this->entered_zones |= bit;
+      this->entered[position] = this->last_change;
+    }
+    for (uint8_t i = 0; i + 1 < this->zones; i++) {
+      uint8_t pair = 3 << i;
+      if ((AllZonesCurrentStatus & pair) == pair) {
+        this->handoffs |= 1 << i;
+      }
+    }
+    this->last_status = AllZonesCurrentStatus;
+    return 0;
+  }
+
+  // if nobody anywhere lets check if an exit or entry has happened
+  ESP_LOGD(TAG, "Nobody anywhere, AllZonesCurrentStatus: %d", AllZonesCurrentStatus);
+  uint8_t left = 1;
+  uint8_t right = 1 << (this->zones - 1);
+  uint8_t all_handoffs = (1 << (this->zones - 1)) - 1;
+  int delta = 0;
+  if (this->handoffs == all_handoffs) {
+    if (this->first_status == left && this->last_status == right) {
+      // This an exit
+      delta = -1;
+      this->transit_time = this->entered[this->zones - 1] - this->entered[0];
+    } else if (this->first_status == right && this->last_status == left) {
+      // This an entry
+      delta = 1;
+      this->transit_time = this->entered[0] - this->entered[this->zones - 1];
+    }
+  }
+  if (delta == 0 && this->first_status == this->last_status) {
+    ESP_LOGD(TAG, "Left where the path started, not counted");
+  }
+  this->first_status = 0;
+  this->last_status = 0;
+  this->handoffs = 0;
+  return delta;
+}
+
+uint32_t PathTracker::occupied_for(uint8_t position) const {
+  if ((this->status & (1 << position)) == 0) {
+    return 0;
+  }
+  return millis() - this->occupied_since[position];
+}
+
+uint32_t PathTracker::stalled_for() const { return this->status != 0 ? millis() - this->last_change : 0; }
+
+void PathTracker::clear(uint8_t position) {
+  this->status &= ~(1 << position);
+  this->last_change = millis();
+  if (this->status == 0) {
+    this->first_status = 0;
+    this->last_status = 0;
+    this->handoffs = 0;
+  }
+}
+
+void PathTracker::expire() {
+  this->last_change = millis();
+  this->first_status = this->status;
+  this->last_status = this->status;
+  this->handoffs = 0;
+  this->entered_zones = this->status;
+  for (uint8_t i = 0; i < this->zones; i++) {
+    if (this->status & (1 << i)) {
+      this->entered[i] = this->last_change;
+    }
+    uint8_t pair = 3 << i;
+    if (i + 1 < this->zones && (this->status & pair) == pair) {
+      this->handoffs |= 1 << i;
+    }
+  }
+}
+
+void PathTracker::reset() {
+  this->status = 0;
+  this->first_status = 0;
+  this->last_status = 0;
+  this->handoffs = 0;
+  this->entered_zones = 0;
+  this->transit_time = 0;
+}
+
+}  // namespace roode
+}  // namespace esphome
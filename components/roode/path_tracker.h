@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace roode {
+#define NOBODY 0
+#define SOMEONE 1
+/** Zones a person walks through, one after another, from one side of the doorway to the other */
+static const uint8_t MAX_PATH_ZONES = 4;
+
+/**
+ * Tracks the path of a person through a row of zones to determine the direction of a crossing.
+ * Zones are numbered from the left, where 0 & 1 are the left & right zone when there are only two.
+ *
+ * A crossing is recognized when the occupied zones start at one end, every neighbouring pair of zones is occupied
+ * at the same time along the way and the last one to be freed is at the other end. With two zones, that is the
+ * sequence 0 1 3 2 0 (exit, from left to right) or 0 2 3 1 0 (entry). Paths which end where they started, like
+ * someone stepping in and turning back, are not counted.
+ * Each Roode instance owns a tracker per lane.
+ */
+class PathTracker {
+ public:
+  /** Number of zones in the row, 2 to MAX_PATH_ZONES. Resets the tracker. */
+  void set_zones(uint8_t zones);
+  uint8_t get_zones() const { return this->zones; }
+  /**
+   * Updates the status of the zone at this position from the left.
+   * Returns 1 when this completed an entry, -1 when it completed an exit, else 0.
+   */
+  int update(uint8_t position, int CurrentZoneStatus);
+  /** Which zones are occupied, bit 0 being the left zone like in AllZonesCurrentStatus */
+  uint8_t get_status() const { return this->status; }
+  bool is_anyone_present() const { return this->status != 0; }
+  /** ms from someone entering the first zone to entering the last, of the last crossing */
+  uint32_t get_transit_time() const { return this->transit_time; }
+  /** ms the zone at this position has been occupied without a break, 0 while it is free */
+  uint32_t occupied_for(uint8_t position) const;
+  /** ms since the occupied zones last changed, 0 while nobody is present */
+  uint32_t stalled_for() const;
+  /** Frees the zone at this position without counting, e.g. when it is blocked. A path it ends is not counted. */
+  void clear(uint8_t position);
+  /** Restarts the path from the zones occupied now, forgetting how it got there */
+  void expire();
+  void reset();
+
+ protected:
+  uint8_t zones{2};
+  uint8_t status{0};
+  /** The zones occupied when the path started, and before the last change */
+  uint8_t first_status{0};
+  uint8_t last_status{0};
+  /** Bit i is set once zones i & i + 1 were occupied at the same time during the path */
+  uint8_t handoffs{0};
+  /** millis() when each zone was first occupied during the path, for the zones in entered_zones */
+  uint32_t entered[MAX_PATH_ZONES]{};
+  uint8_t entered_zones{0};
+  /** millis() when each occupied zone was last occupied, and when the occupied zones last changed */
+  uint32_t occupied_since[MAX_PATH_ZONES]{};
+  uint32_t last_change{0};
+  uint32_t transit_time{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#include "esphome/components/sensor/sensor.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/optional.h"
+
+namespace esphome {
+namespace roode {
+
+class Publisher {
+ public:
+  virtual ~Publisher() = default;
+  /** Publishes a state which was held back by the minimum interval, once that has passed */
+  virtual void flush() = 0;
+};
+
+/**
+ * Publishes the states of an entity only when they change, and at most once per minimum interval.
+ * A state held back by the interval is published by flush(), so the latest state is always published eventually.
+ */
+template<typename Entity, typename State> class StatePublisher : public Publisher {
+ public:
+  void set_entity(Entity *entity, uint32_t min_interval) {
+    this->entity = entity;
+    this->min_interval = min_interval;
+  }
+  bool has_entity() const { return this->entity != nullptr; }
+
+  void publish(const State &state) {
+    if (this->entity == nullptr) {
+      return;
+    }
+    if (this->last.has_value() && *this->last == state) {
+      // Changed back before a held back state was published
+      this->pending.reset();
+      return;
+    }
+    if (this->last.has_value() && millis() - this->last_time < this->min_interval) {
+      this->pending = state;
+      return;
+    }
+    this->send(state);
+  }
+
+  void flush() override {
+    if (this->pending.has_value() && millis() - this->last_time >= this->min_interval) {
+      this->send(*this->pending);
+    }
+  }
+
+ protected:
+  void send(const State &state) {
+    this->entity->publish_state(state);
+    this->last = state;
+    this->last_time = millis();
+    this->pending.reset();
+  }
+
+  Entity *entity{nullptr};
+  uint32_t min_interval{0};
+  optional<State> last{};
+  optional<State> pending{};
+  uint32_t last_time{0};
+};
+
+using SensorPublisher = StatePublisher<sensor::Sensor, float>;
+using BinarySensorPublisher = StatePublisher<binary_sensor::BinarySensor, bool>;
+
+}  // namespace roode
+}  // namespace esphome
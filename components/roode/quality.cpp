@@ -0,0 +1,82 @@
+#include "quality.h"
+
+namespace esphome {
+namespace roode {
+
+const char *sample_quality_name(SampleQuality quality) {
+  switch (quality) {
+    case SampleQuality::Valid:
+      return "valid";
+    case SampleQuality::SigmaFail:
+      return "sigma fail";
+    case SampleQuality::SignalFail:
+      return "signal fail";
+    case SampleQuality::OutOfBounds:
+      return "out of bounds";
+    case SampleQuality::WrapAround:
+      return "wrap-around";
+    case SampleQuality::OtherFail:
+      return "other fail";
+    case SampleQuality::LowSignal:
+      return "low signal";
+    case SampleQuality::HighAmbient:
+      return "high ambient";
+  }
+  return "unknown";
+}
+
+const char *gate_action_name(GateAction action) {
+  switch (action) {
+    case GateAction::Keep:
+      return "keep";
+    case GateAction::DownWeight:
+      return "down-weight";
+    case GateAction::Drop:
+      return "drop";
+  }
+  return "unknown";
+}
+
+SampleQuality QualityGate::classify(const Measurement &measurement) const {
+  switch (measurement.status) {
+    case RangeStatus::Valid:
+    case RangeStatus::NoWrapAroundCheck:
+      // Without continuous ranging every measurement is the first one, its distance is as good as a valid one's
+      break;
+    case RangeStatus::SigmaFail:
+      return SampleQuality::SigmaFail;
+    case RangeStatus::SignalFail:
+      return SampleQuality::SignalFail;
+    case RangeStatus::OutOfBounds:
+      return SampleQuality::OutOfBounds;
+    case RangeStatus::WrapAround:
+      return SampleQuality::WrapAround;
+    default:
+      return SampleQuality::OtherFail;
+  }
+  // Sensors which don't report the rates leave them at 0, which must not count as low signal
+  if (this->min_signal_rate > 0 && measurement.signal_rate > 0 && measurement.signal_rate < this->min_signal_rate) {
+    return SampleQuality::LowSignal;
+  }
+  if (this->max_ambient_rate > 0 && measurement.ambient_rate > this->max_ambient_rate) {
+    return SampleQuality::HighAmbient;
+  }
+  return SampleQuality::Valid;
+}
+
+GateAction QualityGate::action(SampleQuality quality) const {
+  switch (quality) {
+    case SampleQuality::Valid:
+      return GateAction::Keep;
+    case SampleQuality::SigmaFail:
+      return this->sigma_fail;
+    case SampleQuality::LowSignal:
+    case SampleQuality::HighAmbient:
+      return GateAction::Drop;
+    default:
+      return this->drop_invalid ? GateAction::Drop : GateAction::Keep;
+  }
+}
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+
+#include "../tof_sensor/tof_sensor.h"
+
+namespace esphome {
+namespace roode {
+using tof_sensor::Measurement;
+using tof_sensor::RangeStatus;
+
+/** Why a sample is or isn't trusted, from the range status and the configured signal & ambient limits */
+enum class SampleQuality : uint8_t {
+  Valid,
+  SigmaFail,
+  SignalFail,
+  OutOfBounds,
+  WrapAround,
+  /** Any other range status */
+  OtherFail,
+  /** Valid, but below the minimum signal rate */
+  LowSignal,
+  /** Valid, but above the maximum ambient rate */
+  HighAmbient,
+};
+static const uint8_t SAMPLE_QUALITIES = 8;
+const char *sample_quality_name(SampleQuality quality);
+
+/** What a zone does with a sample of a certain quality, before it is filtered */
+enum class GateAction : uint8_t {
+  Keep,
+  /** Only moves the filtered distance half of the way towards the sample */
+  DownWeight,
+  /** Left out, as if the read failed */
+  Drop,
+};
+const char *gate_action_name(GateAction action);
+
+/**
+ * Decides which samples a zone filters, based on the quality the sensor reported with them.
+ * Wrap-around, signal & phase failures measure something other than what is in the zone, so they are dropped.
+ * Sigma failures are only noisy, so they count for less.
+ */
+struct QualityGate {
+  /** Drop wrap-around, signal, phase & other failures, otherwise they are used like valid samples */
+  bool drop_invalid{true};
+  GateAction sigma_fail{GateAction::DownWeight};
+  /** Samples with a lower signal rate are dropped, in kcps. 0 disables the limit. */
+  uint32_t min_signal_rate{0};
+  /** Samples with a higher ambient rate are dropped, in kcps. 0 disables the limit. */
+  uint32_t max_ambient_rate{0};
+  void set_drop_invalid(bool drop) { this->drop_invalid = drop; }
+  void set_sigma_fail(GateAction action) { this->sigma_fail = action; }
+  void set_min_signal_rate(uint32_t rate) { this->min_signal_rate = rate; }
+  void set_max_ambient_rate(uint32_t rate) { this->max_ambient_rate = rate; }
+
+  SampleQuality classify(const Measurement &measurement) const;
+  GateAction action(SampleQuality quality) const;
+};
+
+}  // namespace roode
+}  // namespace esphome
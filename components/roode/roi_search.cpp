@@ -0,0 +1,88 @@
+#include "roi_search.h"
+
+namespace esphome {
+namespace roode {
+/** Steps of the search: the initial ROI, rings of centers 4, 2 & 1 SPADs around the best one, then its size */
+static const uint8_t SEARCH_STEPS = 5;
+static const uint8_t SIZE_STAGE = 4;
+/** Moves of the center in each ring, in steps of the ring */
+static const int8_t RING[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+static const int8_t RING_STEPS[] = {0, 4, 2, 1};
+/** Changes of width & height, so the center stays where it is */
+static const int8_t SIZES[4][2] = {{-2, 0}, {2, 0}, {0, -4}, {0, 4}};
+
+bool RoiBounds::contains(const ROI &roi) const {
+  return roi.width >= 4 && roi.width <= 16 && roi.height >= 4 && roi.height <= 16 && roi.left() >= this->left &&
+         roi.left() + roi.width <= this->right && roi.top() >= this->top && roi.top() + roi.height <= this->bottom;
+}
+
+void RoiSearch::start(const ROI &initial, const RoiBounds &bounds, bool search_center, bool search_width,
+                      bool search_height) {
+  this->bounds = bounds;
+  this->search_center = search_center;
+  this->search_width = search_width;
+  this->search_height = search_height;
+  this->stage = 0;
+  this->index = 0;
+  this->origin = initial;
+  this->current = initial;
+  this->best_roi = initial;
+  this->best_score = 0;
+  this->scored = 0;
+}
+
+bool RoiSearch::score(float score) {
+  this->scored++;
+  if (this->scored == 1 || score > this->best_score) {
+    this->best_score = score;
+    this->best_roi = this->current;
+  }
+  return this->next();
+}
+
+ROI RoiSearch::stage_candidate(uint8_t index) const {
+  ROI roi = this->origin;
+  if (this->stage == SIZE_STAGE) {
+    roi.width += SIZES[index][0];
+    roi.height += SIZES[index][1];
+    return roi;
+  }
+  int column = roi.column() + RING[index][0] * RING_STEPS[this->stage];
+  int row = roi.row() + RING[index][1] * RING_STEPS[this->stage];
+  if (column < 0 || column > 15 || row < 0 || row > 15) {
+    roi.width = 0;  // Outside of any bounds
+    return roi;
+  }
+  roi.center = ROI::center_at(column, row);
+  return roi;
+}
+
+bool RoiSearch::next() {
+  while (true) {
+    if (this->stage == 0 || this->index >= (this->stage == SIZE_STAGE ? 4 : 8)) {
+      // Each stage varies the best ROI of those before it
+      if (++this->stage >= SEARCH_STEPS) {
+        return false;
+      }
+      this->index = 0;
+      this->origin = this->best_roi;
+    }
+    if (this->stage < SIZE_STAGE && !this->search_center) {
+      this->stage = SIZE_STAGE - 1;
+      this->index = 8;
+      continue;
+    }
+    uint8_t index = this->index++;
+    if (this->stage == SIZE_STAGE && !(SIZES[index][0] != 0 ? this->search_width : this->search_height)) {
+      continue;
+    }
+    ROI candidate = this->stage_candidate(index);
+    if (this->bounds.contains(candidate)) {
+      this->current = candidate;
+      return true;
+    }
+  }
+}
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+
+#include "../tof_sensor/roi.h"
+
+namespace esphome {
+namespace roode {
+using tof_sensor::ROI;
+
+/** Part of the SPAD array an ROI has to stay in, in columns & rows like ROI::column() & ROI::row() */
+struct RoiBounds {
+  int left{0};
+  int top{0};
+  int right{16};
+  int bottom{16};
+  bool contains(const ROI &roi) const;
+};
+
+/**
+ * Searches a zone's ROI with the best score, coarse to fine, so it takes at most MAX_CANDIDATES candidates.
+ * Starting with the zone's default ROI, the center moves by 4, then 2, then 1 SPAD in each direction around the
+ * best center so far. Then the size is varied around the best ROI. Configured parts of the ROI are not searched.
+ */
+class RoiSearch {
+ public:
+  /** The start, 3 rings of 8 centers and 4 sizes */
+  static const uint8_t MAX_CANDIDATES = 1 + 3 * 8 + 4;
+
+  void start(const ROI &initial, const RoiBounds &bounds, bool search_center, bool search_width, bool search_height);
+  /** The ROI to score next */
+  const ROI &candidate() const { return this->current; }
+  /** Scores the candidate, higher is better. Returns whether there is another candidate to score. */
+  bool score(float score);
+  const ROI &best() const { return this->best_roi; }
+  float get_best_score() const { return this->best_score; }
+  /** Candidates scored so far */
+  uint8_t get_scored() const { return this->scored; }
+
+ protected:
+  /** Moves on to the next candidate within the bounds, returns false when there is none */
+  bool next();
+  /** Candidate at this index of the current stage, which may be outside the bounds */
+  ROI stage_candidate(uint8_t index) const;
+  RoiBounds bounds;
+  bool search_center{true};
+  bool search_width{true};
+  bool search_height{true};
+  /** 0 is the start, 1-3 the rings of centers by 4, 2 & 1 SPADs, 4 the sizes */
+  uint8_t stage{0};
+  uint8_t index{0};
+  /** The best ROI when the stage started, which its candidates vary */
+  ROI origin{};
+  ROI current{};
+  ROI best_roi{};
+  float best_score{0};
+  uint8_t scored{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -2,12 +2,73 @@
 
 namespace esphome {
 namespace roode {
+/** Ranging modes calibration can choose, their index is saved with the calibration */
+static const RangingMode *const CALIBRATION_RANGING_MODES[] = {Ranging::Shortest, Ranging::Short,  Ranging::Medium,
+                                                               Ranging::Long,     Ranging::Longer, Ranging::Longest};
+/** Reads per zone to check that the saved calibration still matches the scene */
+static const int VALIDATION_ATTEMPTS = 5;
+/** How far the idle distance can be off, in percent, for the saved calibration to be used */
+static const int VALIDATION_TOLERANCE = 10;
+/** Crossings which can be detected between two loops, before they are counted */
+static const uint16_t CROSSING_QUEUE_SIZE = 8;
+/** Buffered events delivered per loop, so a backlog does not stall the loop on reconnect */
+static const int EVENT_BATCH_SIZE = 4;
+/** How often the sensor task checks whether the sensor woke, without an interrupt pin this is an I2C read */
+static const uint32_t WAKE_POLL_INTERVAL = 10;
+/** tan(13.5°), half of the sensor's 27° field of view spans 8 SPADs */
+static const float HALF_FOV_TANGENT = 0.24f;
+/**
+ * Smallest standard deviation an ROI candidate is scored with, in mm. Like the idle estimator's minimum, as a few
+ * reads cannot tell apart noise below it.
+ */
+static const float MIN_SEARCH_DEVIATION = 15.0f;
+/** Separation from the lane's other zones, in SPADs, beyond which an ROI candidate scores no better */
+static const int MAX_SEARCH_SEPARATION = 8;
+#ifdef USE_ROODE_SENSOR_TASK
+/** Longest the sensor task waits after a failed read, doubling from 2ms with each failure in a row */
+static const uint32_t MAX_FAILURE_BACKOFF = 1000;
+static const uint32_t SENSOR_TASK_STACK_SIZE = 4096;
+/** Above the loop task's, so network & API work in the loop cannot delay a read */
+static const UBaseType_t SENSOR_TASK_PRIORITY = 5;
+#endif
+
+uint8_t Roode::instance_count = 0;
+
 void Roode::dump_config() {
   ESP_LOGCONFIG(TAG, "Roode:");
-  ESP_LOGCONFIG(TAG, "  Sample size: %d", samples);
   LOG_UPDATE_INTERVAL(this);
-  entry->dump_config();
-  exit->dump_config();
+  ESP_LOGCONFIG(TAG, "  Persist calibration: %s", YESNO(persist_calibration));
+  ESP_LOGCONFIG(TAG, "  Event buffer: %d", crossing_backlog.get_capacity());
+  if (idle_ranging_mode != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Idle ranging: %s, every %dms, after %ums without presence", idle_ranging_mode->name,
+                  idle_ranging_mode->delay_between_measurements, (unsigned) active_timeout);
+    ESP_LOGCONFIG(TAG, "  Wake on distance: %s", YESNO(distance_wake));
+  }
+  if (roi_search_reads > 0) {
+    ESP_LOGCONFIG(TAG, "  ROI search: %d reads per candidate", roi_search_reads);
+  }
+  ESP_LOGCONFIG(TAG, "  Dwell timeouts: zone %ums, path %ums", (unsigned) zone_timeout, (unsigned) path_timeout);
+  ESP_LOGCONFIG(TAG, "  Zones: %d in %d lane(s)", (int) zones.size(), lanes);
+  for (auto *zone : zones) {
+    zone->dump_config();
+  }
+}
+
+void Roode::set_zone_layout(uint8_t middle, uint8_t lanes) {
+  // Two lanes of more than two zones would need more than MAX_ZONES
+  this->lanes = lanes > 1 ? 2 : 1;
+  this->positions = this->lanes > 1 ? 2 : std::min<uint8_t>(2 + middle, MAX_PATH_ZONES);
+  exit->position = this->positions - 1;
+  for (uint8_t position = 1; position < this->positions - 1; position++) {
+    zones.push_back(new Zone(zones.size(), 0, position));
+  }
+  if (this->lanes > 1) {
+    zones.push_back(new Zone(zones.size(), 1, 0));
+    zones.push_back(new Zone(zones.size(), 1, 1));
+  }
+  for (auto &tracker : path_trackers) {
+    tracker.set_zones(this->positions);
+  }
 }
 
 void Roode::setup() {
@@ -15,51 +76,486 @@ void Roode::setup() {
   if (version_sensor != nullptr) {
     version_sensor->publish_state(VERSION);
   }
-  ESP_LOGI(SETUP, "Using sampling with sampling size: %d", samples);
 
   if (this->distanceSensor->is_failed()) {
     this->mark_failed();
     ESP_LOGE(TAG, "Roode cannot be setup without a valid VL53L1X sensor");
     return;
   }
+  crossing_queue.set_capacity(CROSSING_QUEUE_SIZE);
+  crossing_backlog.set_capacity(event_buffer_size);
+  for (auto *zone : zones) {
+    configured_overrides[zone->id] = *zone->roi_override;
+  }
 
-  calibrate_zones();
+  if (persist_calibration) {
+    calibration_pref = global_preferences->make_preference<CalibrationData>(
+        fnv1_hash("roode_calibration") + instance_index, true);
+  }
+  if (!persist_calibration || !restore_calibration()) {
+    start_calibration();
+  }
+#ifdef USE_ROODE_SENSOR_TASK
+  if (use_sensor_task) {
+    // The loop task's core, where there are two. WiFi & lwIP run on the other one at priorities far above this task's
+    // and would preempt it during their bursts, here only the loop competes, which runs below it.
+    BaseType_t core = portNUM_PROCESSORS > 1 ? 1 : tskNO_AFFINITY;
+    if (xTaskCreatePinnedToCore(Roode::sensor_task, "roode_sensor", SENSOR_TASK_STACK_SIZE, this,
+                                SENSOR_TASK_PRIORITY, &sensor_task_handle, core) == pdPASS) {
+      ESP_LOGI(SETUP, "Reading the sensor in its own task");
+      return;
+    }
+    ESP_LOGW(SETUP, "Could not create the sensor task, reading the sensor in the loop");
+    sensor_task_handle = nullptr;
+  }
+#endif
+  this->high_freq_.start();
 }
 
+#ifdef USE_ROODE_SENSOR_TASK
+void Roode::sensor_task(void *arg) {
+  auto *roode = static_cast<Roode *>(arg);
+  while (true) {
+    bool waiting;
+    {
+      LockGuard guard(roode->state_lock);
+      waiting = !roode->read_sensor();
+    }
+    uint32_t wait = 0;
+    if (roode->read_failures > 0) {
+      // A failing sensor fails right away, back off instead of retrying at full speed
+      wait = std::min<uint32_t>(1u << std::min<uint8_t>(roode->read_failures, 10), MAX_FAILURE_BACKOFF);
+    } else if (waiting && roode->waiting_for_wake) {
+      // While the sensor waits for someone to come close, that may take hours, so it is checked less often
+      wait = WAKE_POLL_INTERVAL;
+    }
+    // Block for at least a tick after every step, the loop task runs on this core at a lower priority
+    vTaskDelay(std::max<TickType_t>(pdMS_TO_TICKS(wait), 1));
+  }
+}
+#endif
+
 void Roode::update() {
-  if (distance_entry != nullptr) {
-    distance_entry->publish_state(entry->getDistance());
+#ifdef USE_ROODE_INSTRUMENTATION
+  auto publish_start = micros();
+#endif
+  uint16_t entry_distance;
+  uint16_t exit_distance;
+  uint32_t quality_counts[SAMPLE_QUALITIES]{};
+  {
+    // Taken at once, so the sensor task is not held up while they are published
+    LockGuard guard(state_lock);
+    entry_distance = entry->getDistance();
+    exit_distance = exit->getDistance();
+    for (auto *zone : zones) {
+      for (uint8_t i = 0; i < SAMPLE_QUALITIES; i++) {
+        quality_counts[i] += zone->get_quality_count(static_cast<SampleQuality>(i));
+      }
+    }
   }
-  if (distance_exit != nullptr) {
-    distance_exit->publish_state(exit->getDistance());
+  distance_entry.publish(entry_distance);
+  distance_exit.publish(exit_distance);
+  publish_sample_quality(quality_counts);
+#ifdef USE_ROODE_INSTRUMENTATION
+  record_latency(Stage::Publish, publish_start);
+  publish_instrumentation();
+#endif
+}
+
+void Roode::publish_sample_quality(const uint32_t *quality_counts) {
+  uint32_t counts[SAMPLE_QUALITIES];
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < SAMPLE_QUALITIES; i++) {
+    counts[i] = quality_counts[i] - last_quality_counts[i];
+    last_quality_counts[i] = quality_counts[i];
+    total += counts[i];
+  }
+  if (total == 0) {
+    return;
+  }
+  // Only the qualities which occurred, e.g. "valid 97.5%, sigma fail 2.0%, wrap-around 0.5%"
+  std::string breakdown;
+  for (uint8_t i = 0; i < SAMPLE_QUALITIES; i++) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    char share[40];
+    snprintf(share, sizeof(share), "%s%s %.1f%%", breakdown.empty() ? "" : ", ",
+             sample_quality_name(static_cast<SampleQuality>(i)), counts[i] * 100.0f / total);
+    breakdown += share;
+  }
+  ESP_LOGD(TAG, "Sample quality of %u reads: %s", (unsigned) total, breakdown.c_str());
+  if (sample_quality_sensor != nullptr) {
+    sample_quality_sensor->publish_state(breakdown);
   }
 }
 
+#ifdef USE_ROODE_INSTRUMENTATION
+static const char *const STAGE_NAMES[STAGES] = {"ROI switch", "Ranging wait", "Result read", "Path tracking",
+                                                 "Publish",    "Sample interval"};
+
+static void publish_optional(sensor::Sensor *sensor, float state) {
+  if (sensor != nullptr) {
+    sensor->publish_state(state);
+  }
+}
+
+void Roode::publish_instrumentation() {
+  // Taken at once & started over, so the sensor task is not held up while they are published
+  LatencyHistogram histograms[STAGES];
+  uint32_t entry_samples;
+  uint32_t exit_samples;
+  uint32_t total_samples = 0;
+  uint32_t transactions;
+  uint32_t latency;
+  {
+    LockGuard guard(state_lock);
+    for (uint8_t stage = 0; stage < STAGES; stage++) {
+      histograms[stage] = latencies[stage];
+      latencies[stage].reset();
+    }
+    entry_samples = entry->get_sample_count();
+    exit_samples = exit->get_sample_count();
+    for (auto *zone : zones) {
+      total_samples += zone->get_sample_count();
+    }
+    transactions = distanceSensor->pop_i2c_transactions();
+    latency = distanceSensor->pop_max_data_ready_latency();
+  }
+
+  for (uint8_t stage = 0; stage < STAGES; stage++) {
+    auto &histogram = histograms[stage];
+    uint32_t values[STATISTICS] = {histogram.percentile(50), histogram.percentile(99), histogram.get_max()};
+    if (histogram.get_count() > 0) {
+      ESP_LOGD(TAG, "%s: p50 %uus, p99 %uus, max %uus over %u", STAGE_NAMES[stage], (unsigned) values[0],
+               (unsigned) values[1], (unsigned) values[2], (unsigned) histogram.get_count());
+    }
+    for (uint8_t statistic = 0; statistic < STATISTICS; statistic++) {
+      publish_optional(latency_sensors[stage][statistic], values[statistic]);
+    }
+  }
+
+  auto now = millis();
+  if (last_rate_time != 0 && now != last_rate_time) {
+    float seconds = (now - last_rate_time) / 1000.0f;
+    float entry_rate = (entry_samples - last_entry_samples) / seconds;
+    float exit_rate = (exit_samples - last_exit_samples) / seconds;
+    // Zones take turns, so each one can get at most its share of the sensor's measurements
+    auto *mode = distanceSensor->get_ranging_mode();
+    float max_rate = mode != nullptr ? 1000.0f / zones.size() / mode->delay_between_measurements : 0;
+    ESP_LOGD(TAG, "Sampling rate: entry %.1f/s, exit %.1f/s, max per zone: %.1f/s", entry_rate, exit_rate, max_rate);
+    publish_optional(sampling_rate_entry_sensor, entry_rate);
+    publish_optional(sampling_rate_exit_sensor, exit_rate);
+  }
+  auto samples = total_samples - last_samples;
+  if (samples > 0 && transactions > 0) {
+    float per_sample = (float) transactions / samples;
+    ESP_LOGD(TAG, "I2C transactions per sample: %.1f", per_sample);
+    publish_optional(i2c_transactions_sensor, per_sample);
+  }
+  ESP_LOGD(TAG, "Max loop duration: %uus", (unsigned) max_loop_time);
+  publish_optional(loop_stall_sensor, max_loop_time);
+  max_loop_time = 0;
+  if (latency > 0) {
+    ESP_LOGD(TAG, "Max data ready to read latency: %uus", (unsigned) latency);
+  }
+  last_rate_time = now;
+  last_entry_samples = entry_samples;
+  last_exit_samples = exit_samples;
+  last_samples = total_samples;
+}
+#endif
+
 void Roode::loop() {
-  // unsigned long start = micros();
-  this->current_zone->readDistance(distanceSensor);
-  // uint16_t samplingDistance = sampling(this->current_zone);
-  path_tracking(this->current_zone);
+#ifdef USE_ROODE_INSTRUMENTATION
+  auto start = micros();
+#endif
+  for (auto *publisher : rate_limited_publishers) {
+    publisher->flush();
+  }
+  deliver_events();
+  publish_states();
+#ifdef USE_ROODE_SENSOR_TASK
+  if (sensor_task_handle != nullptr) {
+    return;
+  }
+#endif
+  read_sensor();
+
+#ifdef USE_ROODE_INSTRUMENTATION
+  auto duration = micros() - start;
+  if (duration > max_loop_time) {
+    max_loop_time = duration;
+  }
+#endif
+}
+
+void Roode::publish_states() {
+  presence_sensor.publish(present.load(std::memory_order_relaxed));
+  blocked_sensor.publish(blocked.load(std::memory_order_relaxed));
+  if (status_changed.exchange(false)) {
+    status_sensor.publish(reported_status.load());
+  }
+  calibration_progress_sensor.publish(calibration_progress.load(std::memory_order_relaxed));
+  if (woke.exchange(false)) {
+    wake_latency_sensor.publish(wake_latency.load() / 1000.0f);
+  }
+  if (configuration_changed.exchange(false)) {
+    publish_sensor_configuration();
+  }
+}
+
+bool Roode::read_sensor() {
+  if (recalibration_requested.exchange(false)) {
+    start_calibration();
+  }
+  switch (this->read_state) {
+    case ReadState::Idle:
+#ifdef USE_ROODE_INSTRUMENTATION
+      measurement_start_time = micros();
+#endif
+      sensor_status = distanceSensor->start_measurement(is_calibrating()     ? &calibration_rois[calibration_zone]
+                                                        : waiting_for_wake ? &wake_roi
+                                                                           : this->current_zone->roi);
+#ifdef USE_ROODE_INSTRUMENTATION
+      if (!is_calibrating()) {
+        record_latency(Stage::RoiSwitch, measurement_start_time);
+      }
+#endif
+      if (sensor_status != VL53L1_ERROR_NONE) {
+        handle_sensor_status();
+        read_failures = std::min(read_failures + 1, UINT8_MAX);
+        break;
+      }
+      this->read_state = ReadState::Ranging;
+      break;
+    case ReadState::Ranging:
+      if (!distanceSensor->is_data_ready(sensor_status)) {
+        if (sensor_status != VL53L1_ERROR_NONE) {
+          // Give up on this measurement and start over
+          handle_sensor_status();
+          read_failures = std::min(read_failures + 1, UINT8_MAX);
+          this->read_state = ReadState::Idle;
+          break;
+        }
+        return false;
+      }
+      read_failures = 0;
+#ifdef USE_ROODE_INSTRUMENTATION
+      if (is_calibrating() || waiting_for_wake) {
+        // Zones are not sampled meanwhile, the next interval starts with their first read
+        last_read_time = 0;
+      }
+#endif
+      if (is_calibrating()) {
+        complete_calibration_read();
+      } else if (waiting_for_wake) {
+        complete_wake_read();
+      } else {
+#ifdef USE_ROODE_INSTRUMENTATION
+        record_latency(Stage::RangingWait, measurement_start_time);
+#endif
+        complete_read();
+      }
+      this->read_state = ReadState::Idle;
+      break;
+  }
+  return true;
+}
+
+void Roode::complete_read() {
+  Zone *next_zone = this->next_zone();
+#ifdef USE_ROODE_INSTRUMENTATION
+  auto start = micros();
+#endif
+  // Let the sensor range the next zone while this one is processed
+  sensor_status = this->current_zone->completeDistance(distanceSensor, next_zone->roi);
+#ifdef USE_ROODE_INSTRUMENTATION
+  record_latency(Stage::ResultRead, start);
+  if (last_read_time != 0) {
+    record_latency(Stage::SampleInterval, last_read_time);
+  }
+  last_read_time = micros();
+#endif
+  if (wake_time.has_value() && sensor_status == VL53L1_ERROR_NONE) {
+    // Tracking resumed, anyone who crosses from now on is counted
+    auto latency = micros() - wake_time.value();
+    wake_time.reset();
+    ESP_LOGD(TAG, "Reading the zones %uus after waking", (unsigned) latency);
+    wake_latency.store(latency);
+    woke = true;
+  }
+  crossing_reads++;
+  // A sample the quality gate dropped leaves the zone's distance as it was, so there is nothing new to track
+  bool tracked = sensor_status == VL53L1_ERROR_NONE && !this->current_zone->was_dropped();
+  if (!tracked) {
+    crossing_errors++;
+  }
+  uint8_t path_status;
+  if (tracked) {
+#ifdef USE_ROODE_INSTRUMENTATION
+    start = micros();
+#endif
+    path_status = path_tracking(this->current_zone);
+#ifdef USE_ROODE_INSTRUMENTATION
+    record_latency(Stage::PathTracking, start);
+#endif
+  } else {
+    path_status = this->path_status();
+  }
+  // A dropped sample left the zone's distance as it was, it is recorded without one like a failed read
+  trace.record(this->current_zone->id, tracked ? this->current_zone->getDistance() : 0, sensor_status,
+               sensor_status == VL53L1_ERROR_NONE && !tracked, path_status);
+  if (sensor_status == VL53L1_ERROR_NONE) {
+    update_ranging_mode(path_status != 0);
+  }
+  if (path_status == 0) {
+    // Nobody is in the zones, the next crossing starts with a clean record
+    crossing_reads = 0;
+    crossing_errors = 0;
+  }
+  handle_sensor_status();
+  this->current_zone = next_zone;
+}
+
+void Roode::reset_path_tracking() {
+  for (uint8_t lane = 0; lane < 2; lane++) {
+    path_trackers[lane].reset();
+    closest_distance[lane] = UINT16_MAX;
+  }
+}
+
+Zone *Roode::next_zone() const {
+  for (uint8_t i = 1; i <= zones.size(); i++) {
+    Zone *zone = zones[(this->current_zone->id + i) % zones.size()];
+    // Everyone passes an outer zone first, the middle ones only matter once someone did
+    bool middle = zone->position != 0 && zone->position != this->positions - 1;
+    if (!middle || path_trackers[zone->lane].is_anyone_present()) {
+      return zone;
+    }
+  }
+  return this->current_zone;
+}
+
+uint8_t Roode::path_status() const {
+  return path_trackers[0].get_status() | (path_trackers[1].get_status() << this->positions);
+}
+
+bool Roode::is_anyone_present() const {
+  return path_trackers[0].is_anyone_present() || path_trackers[1].is_anyone_present();
+}
+
+void Roode::set_idle_ranging_mode(const RangingMode *mode, uint16_t interval) {
+  if (interval > mode->delay_between_measurements) {
+    mode = new RangingMode(mode->name, mode->timing_budget, interval, mode->mode);
+  }
+  idle_ranging_mode = mode;
+}
+
+void Roode::update_ranging_mode(bool present) {
+  if (idle_ranging_mode == nullptr || active_ranging_mode == nullptr) {
+    return;
+  }
+  auto *current = distanceSensor->get_ranging_mode();
+  if (present) {
+    last_active_time = millis();
+    if (current != active_ranging_mode) {
+      ESP_LOGD(TAG, "Someone is present, ranging with %s", active_ranging_mode->name);
+      distanceSensor->set_ranging_mode(active_ranging_mode);
+    }
+  } else if (millis() - last_active_time > active_timeout) {
+    if (current != idle_ranging_mode) {
+      ESP_LOGD(TAG, "Nobody is present, ranging with %s", idle_ranging_mode->name);
+      distanceSensor->set_ranging_mode(idle_ranging_mode);
+    }
+    if (distance_wake) {
+      enter_distance_wake();
+    }
+  }
+}
+
+/** The smallest ROI which covers both ROIs, 199 centers 16x16 */
+static ROI bounding_roi(const ROI &a, const ROI &b) {
+  int left = std::max(0, std::min(a.left(), b.left()));
+  int right = std::min(16, std::max(a.left() + a.width, b.left() + b.width));
+  int top = std::max(0, std::min(a.top(), b.top()));
+  int bottom = std::min(16, std::max(a.top() + a.height, b.top() + b.height));
+  ROI roi{};
+  roi.width = right - left;
+  roi.height = bottom - top;
+  roi.center = ROI::center_at(left + roi.width / 2, top + (roi.height - 1) / 2);
+  return roi;
+}
+
+void Roode::enter_distance_wake() {
+  wake_roi = *entry->roi;
+  // Anything the zones would detect wakes the sensor
+  uint16_t low = entry->threshold->min;
+  uint16_t high = entry->threshold->max;
+  for (auto *zone : zones) {
+    wake_roi = bounding_roi(wake_roi, *zone->roi);
+    low = std::min(low, zone->threshold->min);
+    high = std::max(high, zone->threshold->max);
+  }
+  if (!distanceSensor->set_distance_window(low, high)) {
+    ESP_LOGW(TAG, "The sensor cannot wake on a distance, the zones are ranged while idle");
+    distance_wake = false;
+    return;
+  }
+  ESP_LOGD(TAG, "Waiting for a distance of %d-%dmm, ROI: { width: %d, height: %d, center: %d }", low, high,
+           wake_roi.width, wake_roi.height, wake_roi.center);
+  waiting_for_wake = true;
+  // Abandon the zone's measurement in flight, the next one waits with the wake ROI
+  this->read_state = ReadState::Idle;
+  request_high_frequency(false);
+}
+
+void Roode::leave_distance_wake() {
+  distanceSensor->clear_distance_window();
+  waiting_for_wake = false;
+  this->read_state = ReadState::Idle;
+  request_high_frequency(true);
+}
+
+void Roode::complete_wake_read() {
+  auto result = distanceSensor->complete_measurement(&wake_roi, sensor_status, nullptr);
   handle_sensor_status();
-  this->current_zone = this->current_zone == this->entry ? this->exit : this->entry;
-  // ESP_LOGI("Experimental", "Entry zone: %d, exit zone: %d",
-  // entry->getDistance(Roode::distanceSensor, Roode::sensor_status),
-  // exit->getDistance(Roode::distanceSensor, Roode::sensor_status)); unsigned
-  // long end = micros(); unsigned long delta = end - start; ESP_LOGI("Roode
-  // loop", "loop took %lu microseconds", delta);
+  if (!result.has_value()) {
+    // Keep waiting
+    return;
+  }
+  wake_time = micros();
+  ESP_LOGD(TAG, "Woke up at a distance of %dmm", result.value().distance);
+  leave_distance_wake();
+  // Someone is coming, track them with the calibrated ranging mode from the first read on
+  update_ranging_mode(true);
+  reset_path_tracking();
+  this->current_zone = entry;
+}
+
+void Roode::request_high_frequency(bool request) {
+#ifdef USE_ROODE_SENSOR_TASK
+  if (sensor_task_handle != nullptr) {
+    // The task polls at its own pace
+    return;
+  }
+#endif
+  if (request) {
+    this->high_freq_.start();
+  } else {
+    this->high_freq_.stop();
+  }
 }
 
 bool Roode::handle_sensor_status() {
   bool check_status = false;
   if (last_sensor_status != sensor_status && sensor_status == VL53L1_ERROR_NONE) {
-    if (status_sensor != nullptr) {
-      status_sensor->publish_state(sensor_status);
-    }
+    report_status(sensor_status);
     check_status = true;
   }
   if (sensor_status < 28 && sensor_status != VL53L1_ERROR_NONE) {
     ESP_LOGE(TAG, "Ranging failed with an error. status: %d", sensor_status);
-    status_sensor->publish_state(sensor_status);
+    report_status(sensor_status);
     check_status = false;
   }
 
@@ -68,116 +564,218 @@ bool Roode::handle_sensor_status() {
   return check_status;
 }
 
-void Roode::path_tracking(Zone *zone) {
-  static int PathTrack[] = {0, 0, 0, 0};
-  static int PathTrackFillingSize = 1;  // init this to 1 as we start from state
-                                        // where nobody is any of the zones
-  static int LeftPreviousStatus = NOBODY;
-  static int RightPreviousStatus = NOBODY;
+uint8_t Roode::path_tracking(Zone *zone) {
   int CurrentZoneStatus = NOBODY;
-  int AllZonesCurrentStatus = 0;
-  int AnEventHasOccured = 0;
+  if (zone->check_unblocked()) {
+    update_blocked();
+  }
 
   // PathTrack algorithm
-  if (zone->getMinDistance() < zone->threshold->max && zone->getMinDistance() > zone->threshold->min) {
+  if (zone->getFilteredDistance() < zone->threshold->max && zone->getFilteredDistance() > zone->threshold->min) {
     // Someone is in the sensing area
     CurrentZoneStatus = SOMEONE;
-    if (presence_sensor != nullptr) {
-      presence_sensor->publish_state(true);
+    if (!replaying) {
+      present.store(true, std::memory_order_relaxed);
     }
   }
 
-  // left zone
-  if (zone == (this->invert_direction_ ? this->exit : this->entry)) {
-    if (CurrentZoneStatus != LeftPreviousStatus) {
-      // event in left zone has occured
-      AnEventHasOccured = 1;
-
-      if (CurrentZoneStatus == SOMEONE) {
-        AllZonesCurrentStatus += 1;
-      }
-      // need to check right zone as well ...
-      if (RightPreviousStatus == SOMEONE) {
-        // event in right zone has occured
-        AllZonesCurrentStatus += 2;
-      }
-      // remember for next time
-      LeftPreviousStatus = CurrentZoneStatus;
-    }
+  // Positions count from the left, where the entry zone is unless the direction is inverted
+  auto &tracker = path_trackers[zone->lane];
+  auto &closest = closest_distance[zone->lane];
+  if (CurrentZoneStatus == SOMEONE) {
+    closest = std::min(closest, zone->getFilteredDistance());
   }
-  // right zone
-  else {
-    if (CurrentZoneStatus != RightPreviousStatus) {
-      // event in right zone has occured
-      AnEventHasOccured = 1;
-      if (CurrentZoneStatus == SOMEONE) {
-        AllZonesCurrentStatus += 2;
-      }
-      // need to check left zone as well ...
-      if (LeftPreviousStatus == SOMEONE) {
-        // event in left zone has occured
-        AllZonesCurrentStatus += 1;
-      }
-      // remember for next time
-      RightPreviousStatus = CurrentZoneStatus;
+  uint8_t position = this->invert_direction_ ? this->positions - 1 - zone->position : zone->position;
+  int delta = tracker.update(position, CurrentZoneStatus);
+  if (!replaying) {
+    check_dwell(zone, tracker, position);
+  }
+  if (delta != 0) {
+    ESP_LOGI("Roode pathTracking", "%s detected in lane %d.", delta > 0 ? "Entry" : "Exit", zone->lane + 1);
+    if (replaying) {
+      this->updateCounter(delta);
+    } else {
+      queue_crossing(delta > 0 ? Direction::Entry : Direction::Exit,
+                     crossing_speed(zone->lane, tracker.get_transit_time(), closest));
     }
   }
+  if (!tracker.is_anyone_present()) {
+    closest = UINT16_MAX;
+  }
+
+  if (!replaying && CurrentZoneStatus == NOBODY && !is_anyone_present()) {
+    // nobody is in the sensing area
+    present.store(false, std::memory_order_relaxed);
+  }
+  return path_status();
+}
+
+void Roode::check_dwell(Zone *zone, PathTracker &tracker, uint8_t position) {
+  if (zone_timeout > 0 && tracker.occupied_for(position) > zone_timeout) {
+    // Someone standing or something left in the zone would keep every path from completing, so it becomes the
+    // background and the zone is free for whoever passes it next
+    ESP_LOGW(TAG, "Zone %d was occupied for %us", zone->id, (unsigned) (tracker.occupied_for(position) / 1000));
+    zone->set_background(zone->getFilteredDistance());
+    tracker.clear(position);
+    update_blocked();
+  } else if (path_timeout > 0 && tracker.stalled_for() > path_timeout) {
+    ESP_LOGD(TAG, "Path in lane %d stalled at %d for %ums, starting over", zone->lane + 1, tracker.get_status(),
+             (unsigned) tracker.stalled_for());
+    tracker.expire();
+  }
+}
+
+void Roode::update_blocked() {
+  bool any = false;
+  for (auto *zone : zones) {
+    any |= zone->is_blocked();
+  }
+  blocked.store(any, std::memory_order_relaxed);
+  // The thresholds changed
+  configuration_changed = true;
+}
 
-  // if an event has occured
-  if (AnEventHasOccured) {
-    ESP_LOGD(TAG, "Event has occured, AllZonesCurrentStatus: %d", AllZonesCurrentStatus);
-    if (PathTrackFillingSize < 4) {
-      PathTrackFillingSize++;
+uint16_t Roode::crossing_speed(uint8_t lane, uint32_t transit_time, uint16_t head_distance) const {
+  Zone *first = nullptr;
+  Zone *last = nullptr;
+  for (auto *zone : zones) {
+    if (zone->lane == lane && zone->position == 0) {
+      first = zone;
+    } else if (zone->lane == lane && zone->position == this->positions - 1) {
+      last = zone;
     }
+  }
+  if (first == nullptr || last == nullptr || transit_time == 0 || head_distance == UINT16_MAX) {
+    return 0;
+  }
+  // The distance between the zones' centers at the height of the head. Each SPAD covers 1/16th of the field of view.
+  int spads = this->orientation_ == Parallel ? last->roi->column() - first->roi->column()
+                                              : last->roi->row() - first->roi->row();
+  float distance = abs(spads) / 16.0f * 2 * HALF_FOV_TANGENT * head_distance;
+  return std::min<float>(distance * 1000 / transit_time, UINT16_MAX);
+}
 
-    // if nobody anywhere lets check if an exit or entry has happened
-    if ((LeftPreviousStatus == NOBODY) && (RightPreviousStatus == NOBODY)) {
-      ESP_LOGD(TAG, "Nobody anywhere, AllZonesCurrentStatus: %d", AllZonesCurrentStatus);
-      // check exit or entry only if PathTrackFillingSize is 4 (for example 0 1
-      // 3 2) and last event is 0 (nobobdy anywhere)
-      if (PathTrackFillingSize == 4) {
-        // check exit or entry. no need to check PathTrack[0] == 0 , it is
-        // always the case
-
-        if ((PathTrack[1] == 1) && (PathTrack[2] == 3) && (PathTrack[3] == 2)) {
-          // This an exit
-          ESP_LOGI("Roode pathTracking", "Exit detected.");
-
-          this->updateCounter(-1);
-          if (entry_exit_event_sensor != nullptr) {
-            entry_exit_event_sensor->publish_state("Exit");
-          }
-        } else if ((PathTrack[1] == 2) && (PathTrack[2] == 3) && (PathTrack[3] == 1)) {
-          // This an entry
-          ESP_LOGI("Roode pathTracking", "Entry detected.");
-          this->updateCounter(1);
-          if (entry_exit_event_sensor != nullptr) {
-            entry_exit_event_sensor->publish_state("Entry");
-          }
-        }
-      }
+void Roode::queue_crossing(Direction direction, uint16_t speed) {
+  uint8_t confidence = crossing_reads > 0 ? (crossing_reads - crossing_errors) * 100 / crossing_reads : 100;
+  if (!crossing_queue.push(CrossingEvent{millis(), direction, confidence, speed})) {
+    // Only the event is lost, the loop still counts it
+    ESP_LOGW(TAG, "Crossing queue is full, counting without an event");
+    uncounted.fetch_add(static_cast<int>(direction));
+  }
+}
 
-      PathTrackFillingSize = 1;
-    } else {
-      // update PathTrack
-      // example of PathTrack update
-      // 0
-      // 0 1
-      // 0 1 3
-      // 0 1 3 1
-      // 0 1 3 3
-      // 0 1 3 2 ==> if next is 0 : check if exit
-      PathTrack[PathTrackFillingSize - 1] = AllZonesCurrentStatus;
+void Roode::deliver_events() {
+  CrossingEvent event{};
+  int delta = uncounted.exchange(0);
+  if (delta != 0) {
+    this->updateCounter(delta);
+  }
+  bool buffer = has_event_receiver();
+  while (crossing_queue.pop(event)) {
+    // The counter is always up to date, only the events wait to be delivered
+    this->updateCounter(static_cast<int>(event.direction));
+    if (buffer && !crossing_backlog.push(event)) {
+      CrossingEvent dropped{};
+      crossing_backlog.pop(dropped);
+      ESP_LOGW(TAG, "Event buffer is full, dropping an event from %ums ago", (unsigned) (millis() - dropped.time));
+      crossing_backlog.push(event);
     }
   }
-  if (presence_sensor != nullptr) {
-    if (CurrentZoneStatus == NOBODY && LeftPreviousStatus == NOBODY && RightPreviousStatus == NOBODY) {
-      // nobody is in the sensing area
-      presence_sensor->publish_state(false);
+
+  if (crossing_backlog.empty() || !can_deliver_events()) {
+    return;
+  }
+  for (int i = 0; i < EVENT_BATCH_SIZE && crossing_backlog.pop(event); i++) {
+    deliver_event(event);
+  }
+}
+
+bool Roode::has_event_receiver() const {
+#ifdef USE_ROODE_CROSSING_EVENTS
+  return true;
+#else
+  return entry_exit_event_sensor != nullptr;
+#endif
+}
+
+bool Roode::can_deliver_events() const {
+#ifdef USE_API
+  return api::global_api_server == nullptr || api::global_api_server->is_connected();
+#else
+  return true;
+#endif
+}
+
+void Roode::deliver_event(const CrossingEvent &event) {
+  auto age = millis() - event.time;
+  bool entry = event.direction == Direction::Entry;
+  ESP_LOGD(TAG, "Delivering %s from %ums ago, confidence: %d%%, speed: %.2fm/s", entry ? "entry" : "exit",
+           (unsigned) age, event.confidence, event.speed / 1000.0f);
+  if (entry_exit_event_sensor != nullptr) {
+    entry_exit_event_sensor->publish_state(entry ? "Entry" : "Exit");
+  }
+#ifdef USE_ROODE_CROSSING_EVENTS
+  api_device.fire_homeassistant_event("esphome.roode_crossing", {{"direction", entry ? "entry" : "exit"},
+                                                                  {"age_ms", to_string(age)},
+                                                                  {"confidence", to_string(event.confidence)},
+                                                                  {"speed", value_accuracy_to_string(
+                                                                                event.speed / 1000.0f, 2)}});
+#endif
+}
+
+void Roode::dump_trace() {
+  // Reading pauses while the trace is logged, so no record is overwritten meanwhile
+  LockGuard guard(state_lock);
+  trace.dump();
+}
+
+void Roode::replay_trace(const std::string &trace) {
+#ifdef USE_ROODE_SENSOR_TASK
+  if (sensor_task_handle != nullptr) {
+    ESP_LOGW(TAG, "Traces cannot be replayed while the sensor task is counting");
+    return;
+  }
+#endif
+  auto records = TraceRecorder::decode(trace);
+  ESP_LOGI(TAG, "Replaying trace of %d samples", (int) records.size());
+
+  // Replay from a clean state, so the result only depends on the trace
+  reset_path_tracking();
+  for (auto *zone : zones) {
+    zone->reset_samples();
+  }
+  replaying = true;
+  replay_entries = 0;
+  replay_exits = 0;
+  int mismatches = 0;
+  for (auto &record : records) {
+    if (record.status != 0 || record.dropped) {
+      continue;  // The read failed or the quality gate dropped it, so it never reached path tracking
+    }
+    if (record.zone >= zones.size()) {
+      continue;  // Recorded with another zone layout
     }
+    Zone *zone = zones[record.zone];
+    zone->add_sample(record.distance);
+    if (path_tracking(zone) != record.path_status) {
+      mismatches++;
+    }
+  }
+  replaying = false;
+  ESP_LOGI(TAG, "Replay finished. entries: %d, exits: %d, path status mismatches: %d", replay_entries, replay_exits,
+           mismatches);
+
+  // Live tracking continues from scratch
+  reset_path_tracking();
+  for (auto *zone : zones) {
+    zone->reset_samples();
   }
 }
 void Roode::updateCounter(int delta) {
+  if (replaying) {
+    (delta > 0 ? replay_entries : replay_exits) += 1;
+    return;
+  }
   if (this->people_counter == nullptr) {
     return;
   }
@@ -187,14 +785,9 @@ void Roode::updateCounter(int delta) {
   call.set_value(next);
   call.perform();
 }
-void Roode::recalibration() { calibrate_zones(); }
+void Roode::recalibration() { recalibration_requested = true; }
 
-const RangingMode *Roode::determine_raning_mode(uint16_t average_entry_zone_distance,
-                                                uint16_t average_exit_zone_distance) {
-  uint16_t min = average_entry_zone_distance < average_exit_zone_distance ? average_entry_zone_distance
-                                                                          : average_exit_zone_distance;
-  uint16_t max = average_entry_zone_distance > average_exit_zone_distance ? average_entry_zone_distance
-                                                                          : average_exit_zone_distance;
+const RangingMode *Roode::determine_raning_mode(uint16_t min, uint16_t max) {
   if (min <= short_distance_threshold) {
     return Ranging::Short;
   }
@@ -210,72 +803,394 @@ const RangingMode *Roode::determine_raning_mode(uint16_t average_entry_zone_dist
   return Ranging::Longest;
 }
 
-void Roode::calibrate_zones() {
+void Roode::start_calibration() {
   ESP_LOGI(SETUP, "Calibrating sensor zones");
+  if (waiting_for_wake) {
+    leave_distance_wake();
+  }
+  // Counting pauses until the new calibration is committed
+  reset_path_tracking();
+
+  for (auto *zone : zones) {
+    // A previous search starts over
+    *zone->roi_override = configured_overrides[zone->id];
+    zone->reset_roi(&calibration_rois[zone->id], orientation_, positions, lanes);
+  }
+  distanceSensor->set_ranging_mode(distanceSensor->get_ranging_mode_override().value_or(Ranging::Longest));
+  // Each zone is measured twice, for the ranging mode & for the thresholds, and at most for each search candidate
+  int search_reads = roi_search_reads * RoiSearch::MAX_CANDIDATES;
+  begin_calibration_phase(CalibrationState::Distance, (calibration_samples * 2 + search_reads) * zones.size());
+}
+
+void Roode::begin_calibration_phase(CalibrationState state, int total_reads) {
+  calibration_state = state;
+  calibration_zone = 0;
+  calibration_estimator.reset();
+  calibration_dropped = 0;
+  calibration_reads = 0;
+  calibration_total_reads = total_reads;
+  publish_calibration_progress();
+  // Abandon any measurement in flight, the next one uses the calibration ROI
+  this->read_state = ReadState::Idle;
+}
+
+void Roode::publish_calibration_progress() {
+  int progress = 100;
+  if (calibration_state != CalibrationState::Done) {
+    progress = std::min((calibration_reads + calibration_estimator.get_count()) * 100 / calibration_total_reads, 99);
+  }
+  calibration_progress.store(progress, std::memory_order_relaxed);
+}
+
+void Roode::complete_calibration_read() {
+  auto *roi = &calibration_rois[calibration_zone];
+  auto result = distanceSensor->complete_measurement(roi, sensor_status, nullptr);
+  handle_sensor_status();
+  if (!result.has_value()) {
+    // Failed reads are retried
+    return;
+  }
+  Zone *zone = zones[calibration_zone];
+  auto *gate = zone->quality_gate;
+  bool dropped = gate->action(gate->classify(result.value())) == GateAction::Drop;
+  if (dropped && calibration_state == CalibrationState::RoiSearch) {
+    // Candidates the sensor cannot range well, e.g. those seeing the door frame, are given up on instead
+    if (++calibration_dropped >= roi_search_reads) {
+      score_roi_candidate(true);
+    }
+    return;
+  }
+  if (dropped && calibration_dropped < calibration_samples) {
+    // Retried like failed reads, unless the zone's reads keep failing, e.g. with a floor beyond range
+    calibration_dropped++;
+    return;
+  }
+  calibration_dropped = 0;
+  calibration_estimator.add(result.value().distance);
+  publish_calibration_progress();
 
-  entry->reset_roi(orientation_ == Parallel ? 167 : 195);
-  exit->reset_roi(orientation_ == Parallel ? 231 : 60);
+  int attempts = calibration_state == CalibrationState::Validating  ? VALIDATION_ATTEMPTS
+                 : calibration_state == CalibrationState::RoiSearch ? roi_search_reads
+                                                                    : calibration_samples;
+  if (calibration_estimator.get_rejected() >= attempts) {
+    // Someone is lingering in the zone, or it changed since the first reads
+    ESP_LOGW(CALIBRATION, "Too many outliers, measuring the zone again. zoneId: %d", calibration_zone);
+    calibration_estimator.reset();
+    return;
+  }
+  if (calibration_estimator.get_count() < attempts) {
+    return;
+  }
+  calibration_reads += calibration_estimator.get_count();
+  if (calibration_state == CalibrationState::RoiSearch) {
+    score_roi_candidate(false);
+    return;
+  }
 
-  calibrateDistance();
+  if (calibration_state == CalibrationState::Validating) {
+    // Only trust the saved calibration when the sensor still sees the same idle distances
+    auto idle = calibration_estimator.mean();
+    auto expected = calibration_idle[calibration_zone];
+    if (abs(idle - expected) * 100 > expected * VALIDATION_TOLERANCE) {
+      ESP_LOGI(CALIBRATION, "Scene changed since the calibration was saved. zoneId: %d, idle: %d, now: %d", zone->id,
+               expected, idle);
+      start_calibration();
+      return;
+    }
+  } else {
+    ESP_LOGD(CALIBRATION, "Measured idle distance. zoneId: %d", zone->id);
+    calibration_idle[calibration_zone] = calibration_estimator.idle();
+  }
+  calibration_estimator.reset();
 
-  entry->roi_calibration(entry->threshold->idle, exit->threshold->idle, orientation_);
-  entry->calibrateThreshold(distanceSensor, number_attempts);
-  exit->roi_calibration(entry->threshold->idle, exit->threshold->idle, orientation_);
-  exit->calibrateThreshold(distanceSensor, number_attempts);
+  if (calibration_zone < zones.size() - 1) {
+    calibration_zone++;
+    if (calibration_state == CalibrationState::Thresholds) {
+      zones[calibration_zone]->roi_calibration(&calibration_rois[calibration_zone], min_calibration_idle(),
+                                               orientation_, positions, lanes);
+    }
+    return;
+  }
+  calibration_zone = 0;
 
-  publish_sensor_configuration(entry, exit, true);
-  App.feed_wdt();
-  publish_sensor_configuration(entry, exit, false);
-  ESP_LOGI(SETUP, "Finished calibrating sensor zones");
+  switch (calibration_state) {
+    case CalibrationState::Validating:
+      ESP_LOGI(SETUP, "Restored calibration. ranging: %s", distanceSensor->get_ranging_mode()->name);
+      commit_calibration();
+      break;
+    case CalibrationState::Distance:
+      if (!distanceSensor->get_ranging_mode_override().has_value()) {
+        uint16_t max_idle = *std::max_element(calibration_idle, calibration_idle + zones.size());
+        auto *mode = determine_raning_mode(min_calibration_idle(), max_idle);
+        if (mode != distanceSensor->get_ranging_mode()) {
+          distanceSensor->set_ranging_mode(mode);
+        }
+      }
+      if (roi_search_reads > 0) {
+        begin_roi_search();
+        break;
+      }
+      calibration_state = CalibrationState::Thresholds;
+      entry->roi_calibration(&calibration_rois[0], min_calibration_idle(), orientation_, positions, lanes);
+      break;
+    case CalibrationState::Thresholds:
+      commit_calibration();
+      ESP_LOGI(SETUP, "Finished calibrating sensor zones");
+      if (persist_calibration) {
+        save_calibration();
+        // Write it right away, a reboot should not fall back to the calibration of the old scene
+        global_preferences->sync();
+      }
+      break;
+    case CalibrationState::RoiSearch:
+    case CalibrationState::Done:
+      break;
+  }
 }
 
-void Roode::calibrateDistance() {
-  auto *const initial = distanceSensor->get_ranging_mode_override().value_or(Ranging::Longest);
-  distanceSensor->set_ranging_mode(initial);
+void Roode::begin_roi_search() {
+  ESP_LOGI(CALIBRATION, "Searching the zones' ROIs");
+  // Start with the ROIs which fit the idle distance, as without searching
+  for (auto *zone : zones) {
+    zone->roi_calibration(&calibration_rois[zone->id], min_calibration_idle(), orientation_, positions, lanes);
+  }
+  calibration_state = CalibrationState::RoiSearch;
+  roi_search_start = millis();
+  search_zone_roi();
+}
 
-  entry->calibrateThreshold(distanceSensor, number_attempts);
-  exit->calibrateThreshold(distanceSensor, number_attempts);
+void Roode::search_zone_roi() {
+  Zone *zone = zones[calibration_zone];
+  auto &configured = configured_overrides[zone->id];
+  roi_search.start(calibration_rois[zone->id], roi_search_bounds(zone), !configured.center, !configured.width,
+                   !configured.height);
+  roi_search_margin = 0;
+  roi_search_deviation = 0;
+  calibration_estimator.reset();
+  calibration_dropped = 0;
+}
 
-  if (distanceSensor->get_ranging_mode_override().has_value()) {
+void Roode::score_roi_candidate(bool failed) {
+  Zone *zone = zones[calibration_zone];
+  const ROI &candidate = roi_search.candidate();
+  float score = 0;
+  if (failed) {
+    ESP_LOGD(CALIBRATION, "ROI candidate dropped. zoneId: %d, width: %d, height: %d, center: %d", zone->id,
+             candidate.width, candidate.height, candidate.center);
+  } else {
+    uint16_t margin = zone->threshold->detection_margin(calibration_estimator.mean());
+    float deviation = calibration_estimator.standard_deviation();
+    // Steady reads far enough beyond the threshold, in a zone far enough from the others to tell the direction
+    int separation = std::min(roi_separation(zone, candidate), MAX_SEARCH_SEPARATION);
+    score = margin / std::max(deviation, MIN_SEARCH_DEVIATION) * (1 + (float) separation / MAX_SEARCH_SEPARATION);
+    ESP_LOGD(CALIBRATION,
+             "ROI candidate. zoneId: %d, width: %d, height: %d, center: %d, margin: %dmm, SD: %.1f, score: %.1f",
+             zone->id, candidate.width, candidate.height, candidate.center, margin, deviation, score);
+    if (roi_search.get_scored() == 0 || score > roi_search.get_best_score()) {
+      roi_search_margin = margin;
+      roi_search_deviation = deviation;
+    }
+  }
+  calibration_estimator.reset();
+  calibration_dropped = 0;
+  if (roi_search.score(score)) {
+    calibration_rois[zone->id] = roi_search.candidate();
     return;
   }
-  auto *mode = determine_raning_mode(entry->threshold->idle, exit->threshold->idle);
-  if (mode != initial) {
-    distanceSensor->set_ranging_mode(mode);
+
+  // The best ROI is kept like a configured one, for the thresholds & until the next search
+  auto &best = roi_search.best();
+  calibration_rois[zone->id] = best;
+  *zone->roi_override = best;
+  ESP_LOGI(CALIBRATION,
+           "Searched ROI for zone. zoneId: %d, width: %d, height: %d, center: %d, candidates: %d, detection margin: "
+           "%dmm (%.1f SD)",
+           zone->id, best.width, best.height, best.center, roi_search.get_scored(), roi_search_margin,
+           roi_search_margin / std::max(roi_search_deviation, MIN_SEARCH_DEVIATION));
+  if (calibration_zone < zones.size() - 1) {
+    calibration_zone++;
+    search_zone_roi();
+    return;
   }
+  roi_search_time = millis() - roi_search_start;
+  ESP_LOGI(CALIBRATION, "Finished searching ROIs in %ums", (unsigned) roi_search_time);
+  calibration_zone = 0;
+  calibration_state = CalibrationState::Thresholds;
+  entry->roi_calibration(&calibration_rois[0], min_calibration_idle(), orientation_, positions, lanes);
 }
 
-void Roode::publish_sensor_configuration(Zone *entry, Zone *exit, bool isMax) {
-  if (isMax) {
-    if (max_threshold_entry_sensor != nullptr) {
-      max_threshold_entry_sensor->publish_state(entry->threshold->max);
+RoiBounds Roode::roi_search_bounds(const Zone *zone) const {
+  RoiBounds bounds;
+  bool parallel = orientation_ == Parallel;
+  int &along_start = parallel ? bounds.left : bounds.top;
+  int &along_end = parallel ? bounds.right : bounds.bottom;
+  int &across_start = parallel ? bounds.top : bounds.left;
+  int &across_end = parallel ? bounds.bottom : bounds.right;
+  // Across the walking direction, the zone stays in its lane
+  across_start = zone->lane * (16 / lanes);
+  across_end = across_start + 16 / lanes;
+  // Along it, the zone stays between the lane's other zones, so they keep their order
+  for (auto *other : zones) {
+    if (other == zone || other->lane != zone->lane) {
+      continue;
+    }
+    auto &roi = calibration_rois[other->id];
+    int start = parallel ? roi.left() : roi.top();
+    if (other->position < zone->position) {
+      along_start = std::max(along_start, start + (parallel ? roi.width : roi.height));
+    } else {
+      along_end = std::min(along_end, start);
     }
+  }
+  return bounds;
+}
 
-    if (max_threshold_exit_sensor != nullptr) {
-      max_threshold_exit_sensor->publish_state(exit->threshold->max);
+int Roode::roi_separation(const Zone *zone, const ROI &roi) const {
+  bool parallel = orientation_ == Parallel;
+  int start = parallel ? roi.left() : roi.top();
+  int end = start + (parallel ? roi.width : roi.height);
+  int separation = 16;
+  for (auto *other : zones) {
+    if (other == zone || other->lane != zone->lane) {
+      continue;
     }
-  } else {
-    if (min_threshold_entry_sensor != nullptr) {
-      min_threshold_entry_sensor->publish_state(entry->threshold->min);
+    auto &other_roi = calibration_rois[other->id];
+    int other_start = parallel ? other_roi.left() : other_roi.top();
+    int other_end = other_start + (parallel ? other_roi.width : other_roi.height);
+    separation = std::min(separation, other->position < zone->position ? start - other_end : other_start - end);
+  }
+  return std::max(separation, 0);
+}
+
+uint16_t Roode::min_calibration_idle() const {
+  return *std::min_element(calibration_idle, calibration_idle + zones.size());
+}
+
+void Roode::commit_calibration() {
+  // Zones switch to the new calibration at once, so they are never counted with a partial calibration
+  for (auto *zone : zones) {
+    *zone->roi = calibration_rois[zone->id];
+    zone->set_idle(calibration_idle[zone->id]);
+    zone->reset_samples();
+  }
+  update_blocked();
+  reset_path_tracking();
+  this->current_zone = this->entry;
+  calibration_state = CalibrationState::Done;
+
+  active_ranging_mode = nullptr;
+  last_active_time = millis();
+  auto *calibrated = distanceSensor->get_ranging_mode();
+  if (idle_ranging_mode != nullptr && calibrated != nullptr) {
+    // Thresholds are distances, so they hold in any mode which reaches at least as far as the calibrated one
+    if (idle_ranging_mode->timing_budget >= calibrated->timing_budget) {
+      active_ranging_mode = calibrated;
+    } else {
+      ESP_LOGW(TAG, "Idle ranging mode %s is shorter than the calibrated %s, not switching modes",
+               idle_ranging_mode->name, calibrated->name);
     }
-    if (min_threshold_exit_sensor != nullptr) {
-      min_threshold_exit_sensor->publish_state(exit->threshold->min);
+  }
+  publish_calibration_progress();
+  configuration_changed = true;
+}
+
+void Roode::save_calibration() {
+  auto *mode = distanceSensor->get_ranging_mode();
+  CalibrationData data{};
+  data.config_hash = calibration_config_hash();
+  data.ranging_mode = 0;
+  for (uint8_t i = 0; i < sizeof(CALIBRATION_RANGING_MODES) / sizeof(CALIBRATION_RANGING_MODES[0]); i++) {
+    // Modes are compared by value, each translation unit has its own copies
+    if (mode != nullptr && CALIBRATION_RANGING_MODES[i]->timing_budget == mode->timing_budget &&
+        CALIBRATION_RANGING_MODES[i]->mode == mode->mode) {
+      data.ranging_mode = i;
     }
   }
+  for (auto *zone : zones) {
+    data.zones[zone->id] =
+        ZoneCalibration{zone->threshold->idle, zone->roi->width, zone->roi->height, zone->roi->center};
+  }
+  if (!calibration_pref.save(&data)) {
+    ESP_LOGW(CALIBRATION, "Failed to save calibration");
+    return;
+  }
+  ESP_LOGD(CALIBRATION, "Saved calibration");
+}
 
-  if (entry_roi_height_sensor != nullptr) {
-    entry_roi_height_sensor->publish_state(entry->roi->height);
+bool Roode::restore_calibration() {
+  CalibrationData data{};
+  if (!calibration_pref.load(&data)) {
+    ESP_LOGI(CALIBRATION, "No saved calibration found");
+    return false;
   }
-  if (entry_roi_width_sensor != nullptr) {
-    entry_roi_width_sensor->publish_state(entry->roi->width);
+  if (data.config_hash != calibration_config_hash() ||
+      data.ranging_mode >= sizeof(CALIBRATION_RANGING_MODES) / sizeof(CALIBRATION_RANGING_MODES[0])) {
+    ESP_LOGI(CALIBRATION, "Configuration changed since the calibration was saved");
+    return false;
   }
 
-  if (exit_roi_height_sensor != nullptr) {
-    exit_roi_height_sensor->publish_state(exit->roi->height);
+  // The saved calibration is only committed once it has been validated
+  distanceSensor->set_ranging_mode(CALIBRATION_RANGING_MODES[data.ranging_mode]);
+  for (auto *zone : zones) {
+    auto &saved = data.zones[zone->id];
+    calibration_rois[zone->id] = ROI{saved.roi_width, saved.roi_height, saved.roi_center};
+    calibration_idle[zone->id] = saved.idle;
+  }
+  begin_calibration_phase(CalibrationState::Validating, VALIDATION_ATTEMPTS * zones.size());
+  return true;
+}
+
+uint32_t Roode::calibration_config_hash() const {
+  char config[128];
+  auto *override = distanceSensor->get_ranging_mode_override().value_or(nullptr);
+  snprintf(config, sizeof(config), "%d,%d,%d,%d,%d", orientation_, override != nullptr ? override->timing_budget : 0,
+           lanes, positions, roi_search_reads);
+  std::string key = config;
+  for (auto *zone : zones) {
+    auto *threshold = zone->threshold;
+    // Searched ROIs are calibrated, only the configured overrides count
+    auto &roi = configured_overrides[zone->id];
+    // Thresholds given as distances are configuration, while those given as percentages are calibrated
+    snprintf(config, sizeof(config), ";%d,%d,%d,%d,%d,%d,%d", roi.width, roi.height, roi.center,
+             threshold->min_percentage.value_or(255),
+             threshold->max_percentage.value_or(255), threshold->min_percentage.has_value() ? 0 : threshold->min,
+             threshold->max_percentage.has_value() ? 0 : threshold->max);
+    key += config;
+  }
+  return fnv1_hash(key);
+}
+
+void Roode::publish_sensor_configuration() {
+  // The sensor task changes these while calibrating, so they are copied at once & published after
+  Threshold entry_threshold;
+  Threshold exit_threshold;
+  ROI entry_roi;
+  ROI exit_roi;
+  uint32_t search_time;
+  uint16_t margin = UINT16_MAX;
+  {
+    LockGuard guard(state_lock);
+    entry_threshold = *entry->threshold;
+    exit_threshold = *exit->threshold;
+    entry_roi = *entry->roi;
+    exit_roi = *exit->roi;
+    search_time = roi_search_time;
+    for (auto *zone : zones) {
+      margin = std::min(margin, zone->threshold->detection_margin(zone->threshold->idle));
+    }
   }
-  if (exit_roi_width_sensor != nullptr) {
-    exit_roi_width_sensor->publish_state(exit->roi->width);
+  max_threshold_entry_sensor.publish(entry_threshold.max);
+  max_threshold_exit_sensor.publish(exit_threshold.max);
+  min_threshold_entry_sensor.publish(entry_threshold.min);
+  min_threshold_exit_sensor.publish(exit_threshold.min);
+  entry_roi_height_sensor.publish(entry_roi.height);
+  entry_roi_width_sensor.publish(entry_roi.width);
+  exit_roi_height_sensor.publish(exit_roi.height);
+  exit_roi_width_sensor.publish(exit_roi.width);
+  if (search_time > 0) {
+    roi_search_time_sensor.publish(search_time / 1000.0f);
   }
+  detection_margin_sensor.publish(margin);
 }
 }  // namespace roode
 }  // namespace esphome
\ No newline at end of file
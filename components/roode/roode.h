@@ -1,23 +1,41 @@
 #pragma once
 #include <math.h>
+#include <algorithm>
+#include <atomic>
 
 #include "esphome/components/binary_sensor/binary_sensor.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/text_sensor/text_sensor.h"
 #include "esphome/core/application.h"
 #include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
-#include "../vl53l1x/vl53l1x.h"
+#include "esphome/core/preferences.h"
+#include "../tof_sensor/tof_sensor.h"
+#include "calibration.h"
+#include "events.h"
+#include "instrumentation.h"
 #include "orientation.h"
+#include "path_tracker.h"
+#include "publisher.h"
+#include "roi_search.h"
+#include "trace.h"
 #include "zone.h"
+#ifdef USE_API
+#include "esphome/components/api/api_server.h"
+#endif
+#ifdef USE_ROODE_CROSSING_EVENTS
+#include "esphome/components/api/custom_api_device.h"
+#endif
+#ifdef USE_ROODE_SENSOR_TASK
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
 
-using namespace esphome::vl53l1x;
-using TofSensor = esphome::vl53l1x::VL53L1X;
+using namespace esphome::tof_sensor;
 
 namespace esphome {
 namespace roode {
-#define NOBODY 0
-#define SOMEONE 1
 #define VERSION "1.5.1"
 static const char *const TAG = "Roode";
 static const char *const SETUP = "Setup";
@@ -52,6 +70,9 @@ static int time_budget_in_ms_medium_long = 50;
 static int time_budget_in_ms_long = 100;
 static int time_budget_in_ms_max = 200;  // max range: 4m
 
+/** The phases of reading a zone's distance without blocking the loop */
+enum class ReadState { Idle, Ranging };
+
 class Roode : public PollingComponent {
  public:
   void setup() override;
@@ -65,78 +86,351 @@ class Roode : public PollingComponent {
   void set_tof_sensor(TofSensor *sensor) { this->distanceSensor = sensor; }
   void set_invert_direction(bool dir) { invert_direction_ = dir; }
   void set_orientation(Orientation val) { orientation_ = val; }
-  void set_sampling_size(uint8_t size) {
-    samples = size;
-    entry->set_max_samples(size);
-    exit->set_max_samples(size);
+  /**
+   * Adds zones to the entry & exit zone, up to MAX_ZONES: middle zones between them in a row, or a second lane of
+   * entry & exit zones next to them, for people walking side by side. Each lane is tracked on its own.
+   */
+  void set_zone_layout(uint8_t middle, uint8_t lanes);
+  void set_distance_entry(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(distance_entry, sensor, min_interval);
+  }
+  void set_distance_exit(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(distance_exit, sensor, min_interval);
   }
-  void set_distance_entry(sensor::Sensor *distance_entry_) { distance_entry = distance_entry_; }
-  void set_distance_exit(sensor::Sensor *distance_exit_) { distance_exit = distance_exit_; }
   void set_people_counter(number::Number *counter) { this->people_counter = counter; }
-  void set_max_threshold_entry_sensor(sensor::Sensor *max_threshold_entry_sensor_) {
-    max_threshold_entry_sensor = max_threshold_entry_sensor_;
+  void set_max_threshold_entry_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(max_threshold_entry_sensor, sensor, min_interval);
+  }
+  void set_max_threshold_exit_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(max_threshold_exit_sensor, sensor, min_interval);
+  }
+  void set_min_threshold_entry_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(min_threshold_entry_sensor, sensor, min_interval);
+  }
+  void set_min_threshold_exit_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(min_threshold_exit_sensor, sensor, min_interval);
+  }
+  void set_entry_roi_height_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(entry_roi_height_sensor, sensor, min_interval);
+  }
+  void set_entry_roi_width_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(entry_roi_width_sensor, sensor, min_interval);
+  }
+  void set_exit_roi_height_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(exit_roi_height_sensor, sensor, min_interval);
+  }
+  void set_exit_roi_width_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(exit_roi_width_sensor, sensor, min_interval);
   }
-  void set_max_threshold_exit_sensor(sensor::Sensor *max_threshold_exit_sensor_) {
-    max_threshold_exit_sensor = max_threshold_exit_sensor_;
+  void set_sensor_status_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(status_sensor, sensor, min_interval);
   }
-  void set_min_threshold_entry_sensor(sensor::Sensor *min_threshold_entry_sensor_) {
-    min_threshold_entry_sensor = min_threshold_entry_sensor_;
+  void set_calibration_progress_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(calibration_progress_sensor, sensor, min_interval);
   }
-  void set_min_threshold_exit_sensor(sensor::Sensor *min_threshold_exit_sensor_) {
-    min_threshold_exit_sensor = min_threshold_exit_sensor_;
+  void set_wake_latency_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(wake_latency_sensor, sensor, min_interval);
   }
-  void set_entry_roi_height_sensor(sensor::Sensor *roi_height_sensor_) { entry_roi_height_sensor = roi_height_sensor_; }
-  void set_entry_roi_width_sensor(sensor::Sensor *roi_width_sensor_) { entry_roi_width_sensor = roi_width_sensor_; }
-  void set_exit_roi_height_sensor(sensor::Sensor *roi_height_sensor_) { exit_roi_height_sensor = roi_height_sensor_; }
-  void set_exit_roi_width_sensor(sensor::Sensor *roi_width_sensor_) { exit_roi_width_sensor = roi_width_sensor_; }
-  void set_sensor_status_sensor(sensor::Sensor *status_sensor_) { status_sensor = status_sensor_; }
-  void set_presence_sensor_binary_sensor(binary_sensor::BinarySensor *presence_sensor_) {
-    presence_sensor = presence_sensor_;
+  void set_roi_search_time_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(roi_search_time_sensor, sensor, min_interval);
+  }
+  void set_detection_margin_sensor(sensor::Sensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(detection_margin_sensor, sensor, min_interval);
+  }
+  void set_presence_sensor_binary_sensor(binary_sensor::BinarySensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(presence_sensor, sensor, min_interval);
+  }
+  void set_blocked_sensor_binary_sensor(binary_sensor::BinarySensor *sensor, uint32_t min_interval = 0) {
+    set_publisher(blocked_sensor, sensor, min_interval);
   }
   void set_version_text_sensor(text_sensor::TextSensor *version_sensor_) { version_sensor = version_sensor_; }
   void set_entry_exit_event_text_sensor(text_sensor::TextSensor *entry_exit_event_sensor_) {
     entry_exit_event_sensor = entry_exit_event_sensor_;
   }
+  /** Shares of the sample qualities since the previous update */
+  void set_sample_quality_text_sensor(text_sensor::TextSensor *sensor) { sample_quality_sensor = sensor; }
+  /** Starts calibrating the zones in the background with the next read, counting pauses until it is done */
   void recalibration();
+  bool is_calibrating() const { return calibration_state != CalibrationState::Done; }
+#ifdef USE_ROODE_INSTRUMENTATION
+  void set_latency_sensor(Stage stage, Statistic statistic, sensor::Sensor *sensor) {
+    latency_sensors[static_cast<uint8_t>(stage)][static_cast<uint8_t>(statistic)] = sensor;
+  }
+  void set_loop_stall_sensor(sensor::Sensor *sensor) { loop_stall_sensor = sensor; }
+  void set_sampling_rate_entry_sensor(sensor::Sensor *sensor) { sampling_rate_entry_sensor = sensor; }
+  void set_sampling_rate_exit_sensor(sensor::Sensor *sensor) { sampling_rate_exit_sensor = sensor; }
+  void set_i2c_transactions_sensor(sensor::Sensor *sensor) { i2c_transactions_sensor = sensor; }
+#endif
+#ifdef USE_ROODE_SENSOR_TASK
+  /** Reads the sensor & tracks paths in a task of its own, so the loop only publishes */
+  void set_sensor_task(bool use) { use_sensor_task = use; }
+#endif
+  void set_persist_calibration(bool persist) { persist_calibration = persist; }
+  void set_calibration_samples(int samples) { calibration_samples = samples; }
+  /**
+   * Searches the ROIs of the zones while calibrating, measuring each candidate this many times, instead of placing
+   * them as if the sensor was centered over the doorway. The results are kept as the zones' ROI overrides.
+   */
+  void set_roi_search(uint8_t reads) { roi_search_reads = reads; }
+  /**
+   * Ranges with this mode while nobody is present, instead of the calibrated one.
+   * The interval lengthens the time between measurements, when it is longer than the mode's own.
+   */
+  void set_idle_ranging_mode(const RangingMode *mode, uint16_t interval = 0);
+  /** How long after the last presence to switch back to the idle ranging mode, in ms */
+  void set_active_timeout(uint32_t timeout) { active_timeout = timeout; }
+  /**
+   * While idle, let the sensor wait for a distance within the detection thresholds over all zones,
+   * instead of ranging & tracking them, if it can.
+   */
+  void set_distance_wake(bool wake) { distance_wake = wake; }
+  /**
+   * A zone occupied for longer than the zone timeout is blocked: what it reads becomes its background until it clears.
+   * A path whose zones don't change for longer than the path timeout starts over. Both in ms, 0 disables them.
+   */
+  void set_dwell_timeouts(uint32_t zone, uint32_t path) {
+    zone_timeout = zone;
+    path_timeout = path;
+  }
+  void set_calibration_reject_outliers(bool reject) { calibration_estimator.set_reject_outliers(reject); }
+  /** How many entries & exits are kept until they can be delivered, e.g. while the API is disconnected */
+  void set_event_buffer_size(uint16_t size) { event_buffer_size = size; }
+  void set_trace_size(uint16_t size) { trace.set_capacity(size); }
+  /** Logs the recorded samples, so they can be replayed with replay_trace */
+  void dump_trace();
+  /** Feeds a dumped trace through path tracking, without touching the people counter */
+  void replay_trace(const std::string &trace);
   Zone *entry = new Zone(0);
-  Zone *exit = new Zone(1);
+  Zone *exit = new Zone(1, 0, 1);
+  /** All zones by id, the entry & exit zone first */
+  std::vector<Zone *> zones{entry, exit};
 
  protected:
   TofSensor *distanceSensor;
   Zone *current_zone = entry;
-  sensor::Sensor *distance_entry;
-  sensor::Sensor *distance_exit;
   number::Number *people_counter;
-  sensor::Sensor *max_threshold_entry_sensor;
-  sensor::Sensor *max_threshold_exit_sensor;
-  sensor::Sensor *min_threshold_entry_sensor;
-  sensor::Sensor *min_threshold_exit_sensor;
-  sensor::Sensor *exit_roi_height_sensor;
-  sensor::Sensor *exit_roi_width_sensor;
-  sensor::Sensor *entry_roi_height_sensor;
-  sensor::Sensor *entry_roi_width_sensor;
-  sensor::Sensor *status_sensor;
-  binary_sensor::BinarySensor *presence_sensor;
+  SensorPublisher distance_entry;
+  SensorPublisher distance_exit;
+  SensorPublisher max_threshold_entry_sensor;
+  SensorPublisher max_threshold_exit_sensor;
+  SensorPublisher min_threshold_entry_sensor;
+  SensorPublisher min_threshold_exit_sensor;
+  SensorPublisher exit_roi_height_sensor;
+  SensorPublisher exit_roi_width_sensor;
+  SensorPublisher entry_roi_height_sensor;
+  SensorPublisher entry_roi_width_sensor;
+  SensorPublisher status_sensor;
+  SensorPublisher calibration_progress_sensor;
+  SensorPublisher wake_latency_sensor;
+  SensorPublisher roi_search_time_sensor;
+  SensorPublisher detection_margin_sensor;
+  BinarySensorPublisher presence_sensor;
+  BinarySensorPublisher blocked_sensor;
+  /** Publishers with a minimum interval, which may hold back a state to be published later */
+  std::vector<Publisher *> rate_limited_publishers;
+  template<typename Entity, typename State>
+  void set_publisher(StatePublisher<Entity, State> &publisher, Entity *entity, uint32_t min_interval) {
+    publisher.set_entity(entity, min_interval);
+    if (min_interval > 0) {
+      rate_limited_publishers.push_back(&publisher);
+    }
+  }
   text_sensor::TextSensor *version_sensor;
+  /** Not deduplicated, every entry & exit is an event even when it repeats the previous one */
   text_sensor::TextSensor *entry_exit_event_sensor;
+  text_sensor::TextSensor *sample_quality_sensor{nullptr};
+  /** Both zones' quality counts at the previous update */
+  uint32_t last_quality_counts[SAMPLE_QUALITIES]{};
+  /** Logs & publishes the shares of the sample qualities since the previous update, from the zones' counts */
+  void publish_sample_quality(const uint32_t *quality_counts);
 
   VL53L1_Error last_sensor_status = VL53L1_ERROR_NONE;
   VL53L1_Error sensor_status = VL53L1_ERROR_NONE;
-  void path_tracking(Zone *zone);
+  ReadState read_state{ReadState::Idle};
+  /** Keeps the main loop from sleeping between polls of the sensor */
+  HighFrequencyLoopRequester high_freq_;
+  TraceRecorder trace;
+  bool replaying{false};
+  int replay_entries{0};
+  int replay_exits{0};
+  /** One per lane */
+  PathTracker path_trackers[2];
+  /** The closest distance in each lane while someone is in it, which is where their head is */
+  uint16_t closest_distance[2]{UINT16_MAX, UINT16_MAX};
+  uint8_t lanes{1};
+  /** Zones in each lane, from the entry to the exit zone */
+  uint8_t positions{2};
+  uint32_t zone_timeout{0};
+  uint32_t path_timeout{0};
+  /** Blocks the zone or restarts its lane's path, when they are stuck for longer than the timeouts */
+  void check_dwell(Zone *zone, PathTracker &tracker, uint8_t position);
+  /** Whether any zone is blocked, for the loop to publish */
+  void update_blocked();
+  /** The zone to read after the current one, middle zones only while someone is in their lane */
+  Zone *next_zone() const;
+  /** The lanes' occupied zones, the first lane's in the low bits */
+  uint8_t path_status() const;
+  bool is_anyone_present() const;
+  void reset_path_tracking();
+  /**
+   * Advances reading the sensor by one step: starting a measurement, or completing it once it is ready.
+   * Returns false while waiting for the measurement.
+   */
+  bool read_sensor();
+  /** Measurements in a row which failed to start or to get ready */
+  uint8_t read_failures{0};
+  /**
+   * Held by the sensor task while it reads the sensor, and by the loop while it takes or resets what reading writes
+   * without atomics: the zones' distances & counts, the trace and the instrumentation.
+   */
+  Mutex state_lock;
+#ifdef USE_ROODE_SENSOR_TASK
+  static void sensor_task(void *arg);
+  bool use_sensor_task{false};
+  TaskHandle_t sensor_task_handle{nullptr};
+#endif
+  /**
+   * States determined while reading the sensor, which the loop publishes.
+   * They are only written by read_sensor(), which may run in the sensor task.
+   */
+  void publish_states();
+  void report_status(VL53L1_Error status) {
+    reported_status = status;
+    status_changed = true;
+  }
+  std::atomic<bool> present{false};
+  std::atomic<bool> blocked{false};
+  std::atomic<VL53L1_Error> reported_status{VL53L1_ERROR_NONE};
+  std::atomic<bool> status_changed{false};
+  std::atomic<int> calibration_progress{100};
+  std::atomic<bool> configuration_changed{false};
+  std::atomic<bool> recalibration_requested{false};
+  /** Crossings which did not fit in the queue, for the loop to count */
+  std::atomic<int> uncounted{0};
+  /** From the sensor waking up to the first read of the zones, in µs */
+  std::atomic<uint32_t> wake_latency{0};
+  std::atomic<bool> woke{false};
+  void complete_read();
+  /** Returns which zones are occupied, with the same bits as AllZonesCurrentStatus */
+  uint8_t path_tracking(Zone *zone);
+  /** Hands a detected crossing over to be counted & delivered, without publishing anything */
+  void queue_crossing(Direction direction, uint16_t speed);
+  /** Walking speed in mm/s from the time it took to get from one outer zone of the lane to the other */
+  uint16_t crossing_speed(uint8_t lane, uint32_t transit_time, uint16_t head_distance) const;
+  /** Counts the queued crossings and delivers a batch of the buffered ones, when connected */
+  void deliver_events();
+  bool can_deliver_events() const;
+  void deliver_event(const CrossingEvent &event);
+  bool has_event_receiver() const;
+  /** Crossings on their way from path tracking to the loop, which counts them */
+  SpscRing<CrossingEvent> crossing_queue;
+  /** Crossings which were counted, but not delivered yet */
+  SpscRing<CrossingEvent> crossing_backlog;
+  uint16_t event_buffer_size{32};
+  /** Reads and failed reads since someone entered the zones, for the confidence of the crossing */
+  uint16_t crossing_reads{0};
+  uint16_t crossing_errors{0};
+#ifdef USE_ROODE_CROSSING_EVENTS
+  api::CustomAPIDevice api_device;
+#endif
   bool handle_sensor_status();
-  void calibrateDistance();
-  void calibrate_zones();
-  const RangingMode *determine_raning_mode(uint16_t average_entry_zone_distance, uint16_t average_exit_zone_distance);
-  void publish_sensor_configuration(Zone *entry, Zone *exit, bool isMax);
+  /** Switches between the idle & calibrated ranging modes, based on whether anyone is present */
+  void update_ranging_mode(bool present);
+  void start_calibration();
+  void begin_calibration_phase(CalibrationState state, int total_reads);
+  void complete_calibration_read();
+  /** Switches the zones over to the calibration results */
+  void commit_calibration();
+  void publish_calibration_progress();
+  /** Starts validating the calibration saved in flash, returns whether there is one to validate */
+  bool restore_calibration();
+  void save_calibration();
+  uint32_t calibration_config_hash() const;
+  const RangingMode *determine_raning_mode(uint16_t min_idle_distance, uint16_t max_idle_distance);
+  /** Publishes the thresholds & ROIs, only the changed ones are sent */
+  void publish_sensor_configuration();
   void updateCounter(int delta);
   Orientation orientation_{Parallel};
-  uint8_t samples{2};
   bool invert_direction_{false};
-  int number_attempts = 20;  // TO DO: make this configurable
+  bool persist_calibration{false};
+  ESPPreferenceObject calibration_pref;
+  CalibrationState calibration_state{CalibrationState::Done};
+  /** Id of the zone being calibrated */
+  uint8_t calibration_zone{0};
+  /** The zones' ROIs & idle distances being calibrated, until they are committed */
+  ROI calibration_rois[MAX_ZONES]{};
+  uint16_t calibration_idle[MAX_ZONES]{};
+  /** Smallest idle distance being calibrated, which sizes the ROIs */
+  uint16_t min_calibration_idle() const;
+  /** The zones' ROI overrides as configured, before any search replaced them */
+  ROI configured_overrides[MAX_ZONES]{};
+  uint8_t roi_search_reads{0};
+  RoiSearch roi_search;
+  /** millis() when the search started, and how long the last one took */
+  uint32_t roi_search_start{0};
+  uint32_t roi_search_time{0};
+  /** Margin & standard deviation of the best candidate of the zone being searched */
+  uint16_t roi_search_margin{0};
+  float roi_search_deviation{0};
+  void begin_roi_search();
+  void search_zone_roi();
+  void score_roi_candidate(bool failed);
+  /** Where the zone's ROI may go: its lane, between its neighbours' ROIs */
+  RoiBounds roi_search_bounds(const Zone *zone) const;
+  /** Gap between the ROI and the nearest ROI of the lane's other zones, along the walking direction, in SPADs */
+  int roi_separation(const Zone *zone, const ROI &roi) const;
+  IdleEstimator calibration_estimator;
+  int calibration_reads{0};
+  /** Reads in a row the quality gate dropped while calibrating */
+  int calibration_dropped{0};
+  const RangingMode *idle_ranging_mode{nullptr};
+  /** The calibrated ranging mode, used while someone is present */
+  const RangingMode *active_ranging_mode{nullptr};
+  uint32_t active_timeout{5000};
+  uint32_t last_active_time{0};
+  bool distance_wake{false};
+  /** Whether the sensor waits for someone within its distance window, instead of ranging the zones */
+  bool waiting_for_wake{false};
+  /** Covers all zones, so the sensor wakes for whichever someone comes through first */
+  ROI wake_roi{};
+  /** micros() when the sensor woke, until the zones were read */
+  optional<uint32_t> wake_time{};
+  void enter_distance_wake();
+  void leave_distance_wake();
+  void complete_wake_read();
+  /** The loop only runs at full speed while it reads the sensor & someone may be present */
+  void request_high_frequency(bool request);
+  int calibration_total_reads{1};
+  /** Distinguishes the calibrations of multiple instances in flash */
+  uint8_t instance_index{Roode::instance_count++};
+  static uint8_t instance_count;
+  /** Reads per zone to determine its idle distance */
+  int calibration_samples{20};
   int short_distance_threshold = 1300;
   int medium_distance_threshold = 2000;
   int medium_long_distance_threshold = 2700;
   int long_distance_threshold = 3400;
+#ifdef USE_ROODE_INSTRUMENTATION
+  void record_latency(Stage stage, uint32_t start) {
+    latencies[static_cast<uint8_t>(stage)].record(micros() - start);
+  }
+  /** Logs & publishes the statistics since the previous update, then starts over */
+  void publish_instrumentation();
+  LatencyHistogram latencies[STAGES];
+  sensor::Sensor *latency_sensors[STAGES][STATISTICS]{};
+  sensor::Sensor *loop_stall_sensor{nullptr};
+  sensor::Sensor *sampling_rate_entry_sensor{nullptr};
+  sensor::Sensor *sampling_rate_exit_sensor{nullptr};
+  sensor::Sensor *i2c_transactions_sensor{nullptr};
+  uint32_t measurement_start_time{0};
+  /** When the previous zone's result was read, 0 before the first one */
+  uint32_t last_read_time{0};
+  uint32_t max_loop_time{0};
+  uint32_t last_rate_time{0};
+  uint32_t last_entry_samples{0};
+  uint32_t last_exit_samples{0};
+  uint32_t last_samples{0};
+#endif
 };
 
 }  // namespace roode
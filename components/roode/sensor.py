@@ -9,7 +9,7 @@ from esphome.const import (
     UNIT_EMPTY,
     ENTITY_CATEGORY_DIAGNOSTIC,
 )
-from . import Roode, CONF_ROODE_ID
+from . import Roode, CONF_ROODE_ID, roode_ns
 
 DEPENDENCIES = ["roode"]
 
@@ -24,6 +24,52 @@ CONF_ROI_WIDTH_entry = "roi_width_entry"
 CONF_ROI_HEIGHT_exit = "roi_height_exit"
 CONF_ROI_WIDTH_exit = "roi_width_exit"
 SENSOR_STATUS = "sensor_status"
+CONF_CALIBRATION_PROGRESS = "calibration_progress"
+CONF_LATENCY = "latency"
+CONF_MIN_PUBLISH_INTERVAL = "min_publish_interval"
+CONF_I2C_TRANSACTIONS = "i2c_transactions"
+CONF_LOOP_STALL = "loop_stall"
+CONF_SAMPLING_RATE_entry = "sampling_rate_entry"
+CONF_SAMPLING_RATE_exit = "sampling_rate_exit"
+CONF_WAKE_LATENCY = "wake_latency"
+CONF_ROI_SEARCH_TIME = "roi_search_time"
+CONF_DETECTION_MARGIN = "detection_margin"
+
+# States are only published when they change, and at most once per this interval
+PUBLISH_SCHEMA = cv.Schema(
+    {cv.Optional(CONF_MIN_PUBLISH_INTERVAL): cv.positive_time_period_milliseconds}
+)
+
+Stage = roode_ns.enum("Stage", is_class=True)
+STAGES = {
+    "roi_switch": Stage.RoiSwitch,
+    "ranging_wait": Stage.RangingWait,
+    "result_read": Stage.ResultRead,
+    "path_tracking": Stage.PathTracking,
+    "publish": Stage.Publish,
+    "sample_interval": Stage.SampleInterval,
+}
+Statistic = roode_ns.enum("Statistic", is_class=True)
+STATISTICS = {
+    "p50": Statistic.P50,
+    "p99": Statistic.P99,
+    "max": Statistic.Max,
+}
+
+duration_schema = sensor.sensor_schema(
+    icon="mdi:timer-outline",
+    unit_of_measurement="µs",
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
+sampling_rate_schema = sensor.sensor_schema(
+    icon="mdi:speedometer",
+    unit_of_measurement="Hz",
+    accuracy_decimals=1,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+)
 
 CONFIG_SCHEMA = sensor.sensor_schema().extend(
     {
@@ -33,112 +79,207 @@ CONFIG_SCHEMA = sensor.sensor_schema().extend(
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_DISTANCE_exit): sensor.sensor_schema(
             icon=ICON_RULER,
             unit_of_measurement="mm",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_MAX_THRESHOLD_entry): sensor.sensor_schema(
             icon="mdi:map-marker-distance",
             unit_of_measurement="mm",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_MAX_THRESHOLD_exit): sensor.sensor_schema(
             icon="mdi:map-marker-distance",
             unit_of_measurement="mm",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_MIN_THRESHOLD_entry): sensor.sensor_schema(
             icon="mdi:map-marker-distance",
             unit_of_measurement="mm",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_MIN_THRESHOLD_exit): sensor.sensor_schema(
             icon="mdi:map-marker-distance",
             unit_of_measurement="mm",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_ROI_HEIGHT_entry): sensor.sensor_schema(
             icon="mdi:table-row-height",
             unit_of_measurement="px",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_ROI_WIDTH_entry): sensor.sensor_schema(
             icon="mdi:table-column-width",
             unit_of_measurement="px",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_ROI_HEIGHT_exit): sensor.sensor_schema(
             icon="mdi:table-row-height",
             unit_of_measurement="px",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(CONF_ROI_WIDTH_exit): sensor.sensor_schema(
             icon="mdi:table-column-width",
             unit_of_measurement="px",
             accuracy_decimals=0,
             state_class=STATE_CLASS_MEASUREMENT,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
-        ),
+        ).extend(PUBLISH_SCHEMA),
         cv.Optional(SENSOR_STATUS): sensor.sensor_schema(
             icon="mdi:check-circle",
             accuracy_decimals=0,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ).extend(PUBLISH_SCHEMA),
+        cv.Optional(CONF_CALIBRATION_PROGRESS): sensor.sensor_schema(
+            icon="mdi:progress-wrench",
+            unit_of_measurement="%",
+            accuracy_decimals=0,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ).extend(PUBLISH_SCHEMA),
+        cv.Optional(CONF_WAKE_LATENCY): sensor.sensor_schema(
+            icon="mdi:timer-outline",
+            unit_of_measurement="ms",
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ).extend(PUBLISH_SCHEMA),
+        cv.Optional(CONF_ROI_SEARCH_TIME): sensor.sensor_schema(
+            icon="mdi:timer-outline",
+            unit_of_measurement="s",
+            accuracy_decimals=1,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ).extend(PUBLISH_SCHEMA),
+        # The smallest over the zones
+        cv.Optional(CONF_DETECTION_MARGIN): sensor.sensor_schema(
+            icon="mdi:map-marker-distance",
+            unit_of_measurement="mm",
+            accuracy_decimals=0,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ).extend(PUBLISH_SCHEMA),
+        cv.Optional(CONF_LATENCY): cv.Schema(
+            {
+                cv.Optional(stage): cv.Schema(
+                    {cv.Optional(statistic): duration_schema for statistic in STATISTICS}
+                )
+                for stage in STAGES
+            }
+        ),
+        cv.Optional(CONF_LOOP_STALL): duration_schema,
+        cv.Optional(CONF_SAMPLING_RATE_entry): sampling_rate_schema,
+        cv.Optional(CONF_SAMPLING_RATE_exit): sampling_rate_schema,
+        # Per sample
+        cv.Optional(CONF_I2C_TRANSACTIONS): sensor.sensor_schema(
+            icon="mdi:swap-horizontal",
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
         ),
         cv.GenerateID(CONF_ROODE_ID): cv.use_id(Roode),
     }
 )
 
 
+def min_interval(config):
+    interval = config.get(CONF_MIN_PUBLISH_INTERVAL)
+    return interval.total_milliseconds if interval is not None else 0
+
+
 async def to_code(config):
     var = await cg.get_variable(config[CONF_ROODE_ID])
     if CONF_DISTANCE_entry in config:
         distance = await sensor.new_sensor(config[CONF_DISTANCE_entry])
-        cg.add(var.set_distance_entry(distance))
+        cg.add(var.set_distance_entry(distance, min_interval(config[CONF_DISTANCE_entry])))
     if CONF_DISTANCE_exit in config:
         distance = await sensor.new_sensor(config[CONF_DISTANCE_exit])
-        cg.add(var.set_distance_exit(distance))
+        cg.add(var.set_distance_exit(distance, min_interval(config[CONF_DISTANCE_exit])))
     if CONF_MAX_THRESHOLD_entry in config:
         count = await sensor.new_sensor(config[CONF_MAX_THRESHOLD_entry])
-        cg.add(var.set_max_threshold_entry_sensor(count))
+        cg.add(var.set_max_threshold_entry_sensor(count, min_interval(config[CONF_MAX_THRESHOLD_entry])))
     if CONF_MAX_THRESHOLD_exit in config:
         count = await sensor.new_sensor(config[CONF_MAX_THRESHOLD_exit])
-        cg.add(var.set_max_threshold_exit_sensor(count))
+        cg.add(var.set_max_threshold_exit_sensor(count, min_interval(config[CONF_MAX_THRESHOLD_exit])))
     if CONF_MIN_THRESHOLD_entry in config:
         count = await sensor.new_sensor(config[CONF_MIN_THRESHOLD_entry])
-        cg.add(var.set_min_threshold_entry_sensor(count))
+        cg.add(var.set_min_threshold_entry_sensor(count, min_interval(config[CONF_MIN_THRESHOLD_entry])))
     if CONF_MIN_THRESHOLD_exit in config:
         count = await sensor.new_sensor(config[CONF_MIN_THRESHOLD_exit])
-        cg.add(var.set_min_threshold_exit_sensor(count))
+        cg.add(var.set_min_threshold_exit_sensor(count, min_interval(config[CONF_MIN_THRESHOLD_exit])))
     if CONF_ROI_HEIGHT_entry in config:
         count = await sensor.new_sensor(config[CONF_ROI_HEIGHT_entry])
-        cg.add(var.set_entry_roi_height_sensor(count))
+        cg.add(var.set_entry_roi_height_sensor(count, min_interval(config[CONF_ROI_HEIGHT_entry])))
     if CONF_ROI_WIDTH_entry in config:
         count = await sensor.new_sensor(config[CONF_ROI_WIDTH_entry])
-        cg.add(var.set_entry_roi_width_sensor(count))
+        cg.add(var.set_entry_roi_width_sensor(count, min_interval(config[CONF_ROI_WIDTH_entry])))
     if CONF_ROI_HEIGHT_exit in config:
         count = await sensor.new_sensor(config[CONF_ROI_HEIGHT_exit])
-        cg.add(var.set_exit_roi_height_sensor(count))
+        cg.add(var.set_exit_roi_height_sensor(count, min_interval(config[CONF_ROI_HEIGHT_exit])))
     if CONF_ROI_WIDTH_exit in config:
         count = await sensor.new_sensor(config[CONF_ROI_WIDTH_exit])
-        cg.add(var.set_exit_roi_width_sensor(count))
+        cg.add(var.set_exit_roi_width_sensor(count, min_interval(config[CONF_ROI_WIDTH_exit])))
     if SENSOR_STATUS in config:
         count = await sensor.new_sensor(config[SENSOR_STATUS])
-        cg.add(var.set_sensor_status_sensor(count))
+        cg.add(var.set_sensor_status_sensor(count, min_interval(config[SENSOR_STATUS])))
+    if CONF_CALIBRATION_PROGRESS in config:
+        progress = await sensor.new_sensor(config[CONF_CALIBRATION_PROGRESS])
+        cg.add(var.set_calibration_progress_sensor(progress, min_interval(config[CONF_CALIBRATION_PROGRESS])))
+    if CONF_WAKE_LATENCY in config:
+        latency = await sensor.new_sensor(config[CONF_WAKE_LATENCY])
+        cg.add(var.set_wake_latency_sensor(latency, min_interval(config[CONF_WAKE_LATENCY])))
+    if CONF_ROI_SEARCH_TIME in config:
+        search_time = await sensor.new_sensor(config[CONF_ROI_SEARCH_TIME])
+        cg.add(var.set_roi_search_time_sensor(search_time, min_interval(config[CONF_ROI_SEARCH_TIME])))
+    if CONF_DETECTION_MARGIN in config:
+        margin = await sensor.new_sensor(config[CONF_DETECTION_MARGIN])
+        cg.add(var.set_detection_margin_sensor(margin, min_interval(config[CONF_DETECTION_MARGIN])))
+
+    await setup_instrumentation(var, config)
+
+
+async def setup_instrumentation(var, config):
+    """Instrumentation is only compiled in when any of its sensors are used"""
+    if not any(
+        key in config
+        for key in (
+            CONF_LATENCY,
+            CONF_LOOP_STALL,
+            CONF_SAMPLING_RATE_entry,
+            CONF_SAMPLING_RATE_exit,
+            CONF_I2C_TRANSACTIONS,
+        )
+    ):
+        return
+    cg.add_define("USE_ROODE_INSTRUMENTATION")
+    for stage, statistics in config.get(CONF_LATENCY, {}).items():
+        for statistic, sensor_config in statistics.items():
+            sens = await sensor.new_sensor(sensor_config)
+            cg.add(var.set_latency_sensor(STAGES[stage], STATISTICS[statistic], sens))
+    if CONF_LOOP_STALL in config:
+        sens = await sensor.new_sensor(config[CONF_LOOP_STALL])
+        cg.add(var.set_loop_stall_sensor(sens))
+    if CONF_SAMPLING_RATE_entry in config:
+        sens = await sensor.new_sensor(config[CONF_SAMPLING_RATE_entry])
+        cg.add(var.set_sampling_rate_entry_sensor(sens))
+    if CONF_SAMPLING_RATE_exit in config:
+        sens = await sensor.new_sensor(config[CONF_SAMPLING_RATE_exit])
+        cg.add(var.set_sampling_rate_exit_sensor(sens))
+    if CONF_I2C_TRANSACTIONS in config:
+        sens = await sensor.new_sensor(config[CONF_I2C_TRANSACTIONS])
+        cg.add(var.set_i2c_transactions_sensor(sens))
@@ -0,0 +1,42 @@
+#include "sliding_min.h"
+
+namespace esphome {
+namespace roode {
+
+void SlidingMin::set_capacity(uint8_t capacity) {
+  delete[] this->candidates;
+  this->candidates = capacity > 0 ? new Candidate[capacity] : nullptr;
+  this->capacity = capacity;
+  this->clear();
+}
+
+void SlidingMin::push(uint16_t value) {
+  if (this->capacity == 0) {
+    return;
+  }
+  // Drop the oldest candidate once it has left the window
+  if (this->count > 0 && this->pushed - this->candidates[this->head].index >= this->capacity) {
+    this->head = (this->head + 1) % this->capacity;
+    this->count--;
+  }
+  // Newer candidates which are not smaller than this one can never be the minimum again
+  while (this->count > 0) {
+    uint8_t newest = (this->head + this->count - 1) % this->capacity;
+    if (this->candidates[newest].value < value) {
+      break;
+    }
+    this->count--;
+  }
+  this->candidates[(this->head + this->count) % this->capacity] = {this->pushed, value};
+  this->count++;
+  this->pushed++;
+}
+
+void SlidingMin::clear() {
+  this->head = 0;
+  this->count = 0;
+  this->pushed = 0;
+}
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+
+namespace esphome {
+namespace roode {
+
+/**
+ * Minimum of the most recent samples, with O(1) (amortized) pushes & queries.
+ * Memory is allocated once, when the capacity is set.
+ */
+class SlidingMin {
+ public:
+  SlidingMin() = default;
+  SlidingMin(const SlidingMin &) = delete;
+  SlidingMin &operator=(const SlidingMin &) = delete;
+  ~SlidingMin() { delete[] this->candidates; }
+  void set_capacity(uint8_t capacity);
+  uint8_t get_capacity() const { return this->capacity; }
+  void push(uint16_t value);
+  /** Minimum of the samples in the window. Only valid when not empty. */
+  uint16_t min() const { return this->candidates[this->head].value; }
+  bool empty() const { return this->count == 0; }
+  void clear();
+
+ protected:
+  struct Candidate {
+    /** Number of samples pushed before this one, to know when it leaves the window */
+    uint32_t index;
+    uint16_t value;
+  };
+  /**
+   * Ring buffer of the samples which can still become the minimum: each is smaller than all samples after it.
+   * So they are increasing in value from the oldest at head, which is the minimum, to the newest.
+   */
+  Candidate *candidates{nullptr};
+  uint8_t capacity{0};
+  uint8_t head{0};
+  uint8_t count{0};
+  uint32_t pushed{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
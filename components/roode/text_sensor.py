@@ -14,8 +14,9 @@ DEPENDENCIES = ["roode"]
 VERSION = "version"
 ENTRY_EXIT_EVENT = "entry_exit_event"
 STATUS = "sensor_status"
+SAMPLE_QUALITY = "sample_quality"
 
-TYPES = [VERSION, ENTRY_EXIT_EVENT, STATUS]
+TYPES = [VERSION, ENTRY_EXIT_EVENT, STATUS, SAMPLE_QUALITY]
 
 CONFIG_SCHEMA = cv.Schema(
     {
@@ -38,6 +39,15 @@ CONFIG_SCHEMA = cv.Schema(
                 ): cv.entity_category,
             }
         ),
+        cv.Optional(SAMPLE_QUALITY): text_sensor.text_sensor_schema().extend(
+            {
+                cv.Optional(CONF_ICON, default="mdi:signal-cellular-3"): cv.icon,
+                cv.GenerateID(): cv.declare_id(text_sensor.TextSensor),
+                cv.Optional(
+                    CONF_ENTITY_CATEGORY, default=ENTITY_CATEGORY_DIAGNOSTIC
+                ): cv.entity_category,
+            }
+        ),
     }
 )
 
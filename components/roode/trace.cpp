@@ -0,0 +1,89 @@
+#include "trace.h"
+#include <algorithm>
+#include <cstdlib>
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+
+namespace esphome {
+namespace roode {
+static const char *const TRACE = "Trace";
+/** Records per logged line. A multiple of 3, so the base64 lines can be concatenated. */
+static const uint16_t RECORDS_PER_LINE = 48;
+
+uint32_t TraceRecord::encode() const {
+  return (uint32_t(std::min<uint16_t>(delta, 1023)) << 22) | (uint32_t(dropped) << 21) |
+         (uint32_t(std::min<uint16_t>(distance, 4095)) << 9) | (uint32_t(zone & 0x3) << 7) |
+         (uint32_t(path_status & 0xF) << 3) | (std::min<uint8_t>(status, 7));
+}
+
+TraceRecord TraceRecord::decode(uint32_t packed) {
+  TraceRecord record{};
+  record.delta = packed >> 22;
+  record.dropped = (packed >> 21) & 0x1;
+  record.distance = (packed >> 9) & 0xFFF;
+  record.zone = (packed >> 7) & 0x3;
+  record.path_status = (packed >> 3) & 0xF;
+  record.status = packed & 0x7;
+  return record;
+}
+
+void TraceRecorder::set_capacity(uint16_t capacity) {
+  delete[] this->records;
+  this->records = capacity > 0 ? new uint32_t[capacity] : nullptr;
+  this->capacity = capacity;
+  this->head = 0;
+  this->count = 0;
+}
+
+void TraceRecorder::record(uint8_t zone, uint16_t distance, VL53L1_Error status, bool dropped, uint8_t path_status) {
+  if (this->capacity == 0) {
+    return;
+  }
+  auto now = millis();
+  TraceRecord record{};
+  record.delta = this->count == 0 ? 0 : std::min<uint32_t>(now - this->last_time, 1023);
+  record.zone = zone;
+  record.distance = distance;
+  record.status = std::min(std::abs(status), 7);
+  record.dropped = dropped;
+  record.path_status = path_status;
+  this->last_time = now;
+
+  this->records[this->head] = record.encode();
+  this->head = (this->head + 1) % this->capacity;
+  if (this->count < this->capacity) {
+    this->count++;
+  }
+}
+
+void TraceRecorder::dump() const {
+  ESP_LOGI(TRACE, "Begin trace of %d samples", this->count);
+  uint8_t line[RECORDS_PER_LINE * 4];
+  uint16_t start = (this->head + this->capacity - this->count) % std::max<uint16_t>(this->capacity, 1);
+  for (uint16_t i = 0; i < this->count; i += RECORDS_PER_LINE) {
+    uint16_t records = std::min<uint16_t>(RECORDS_PER_LINE, this->count - i);
+    for (uint16_t j = 0; j < records; j++) {
+      uint32_t packed = this->records[(start + i + j) % this->capacity];
+      line[j * 4] = packed & 0xFF;
+      line[j * 4 + 1] = (packed >> 8) & 0xFF;
+      line[j * 4 + 2] = (packed >> 16) & 0xFF;
+      line[j * 4 + 3] = packed >> 24;
+    }
+    ESP_LOGI(TRACE, "%s", base64_encode(line, records * 4).c_str());
+  }
+  ESP_LOGI(TRACE, "End trace");
+}
+
+std::vector<TraceRecord> TraceRecorder::decode(const std::string &base64) {
+  auto bytes = base64_decode(base64);
+  std::vector<TraceRecord> records;
+  records.reserve(bytes.size() / 4);
+  for (size_t i = 0; i + 3 < bytes.size(); i += 4) {
+    uint32_t packed = bytes[i] | (bytes[i + 1] << 8) | (bytes[i + 2] << 16) | (uint32_t(bytes[i + 3]) << 24);
+    records.push_back(TraceRecord::decode(packed));
+  }
+  return records;
+}
+
+}  // namespace roode
+}  // namespace esphome
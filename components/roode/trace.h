@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "esphome/core/log.h"
+#include "../tof_sensor/tof_sensor.h"
+
+namespace esphome {
+namespace roode {
+
+/** A single sample as stored in a trace */
+struct TraceRecord {
+  /** Milliseconds since the previous record, saturates at 1023 */
+  uint16_t delta;
+  /** Zone id, 0 for entry and 1 for exit, 2 & 3 for the additional zones */
+  uint8_t zone;
+  /** Distance in mm, saturates at 4095, beyond the sensor's range */
+  uint16_t distance;
+  /** The quality gate dropped the sample, so it never reached path tracking */
+  bool dropped;
+  /** Magnitude of the sensor status, 0 for a valid sample, saturates at 7 */
+  uint8_t status;
+  /** Which zones are occupied after this sample, the first lane's positions in the low bits */
+  uint8_t path_status;
+
+  /**
+   * Packs the record into 32 bits: delta:10 dropped:1 distance:12 zone:2 path_status:4 status:3.
+   * The dropped flag took the top bit of the distance, so older traces decode the same below 4096mm.
+   */
+  uint32_t encode() const;
+  static TraceRecord decode(uint32_t packed);
+};
+
+/**
+ * Records the most recent samples in a fixed-size ring buffer, 4 bytes per sample.
+ * Memory is allocated once, when the capacity is set.
+ */
+class TraceRecorder {
+ public:
+  void set_capacity(uint16_t capacity);
+  uint16_t get_capacity() const { return this->capacity; }
+  bool is_enabled() const { return this->capacity > 0; }
+  void record(uint8_t zone, uint16_t distance, VL53L1_Error status, bool dropped, uint8_t path_status);
+  /** Logs the recorded samples as base64, oldest first. The lines concatenated can be given to decode(). */
+  void dump() const;
+  static std::vector<TraceRecord> decode(const std::string &base64);
+
+ protected:
+  uint32_t *records{nullptr};
+  uint16_t capacity{0};
+  /** Index the next record is written to */
+  uint16_t head{0};
+  uint16_t count{0};
+  uint32_t last_time{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -2,56 +2,101 @@
 
 namespace esphome {
 namespace roode {
+/**
+ * Dropped samples in a row, after which they are used anyway.
+ * The sensor keeps failing with the scene as it is, e.g. a floor beyond range, which must not freeze the zone.
+ */
+static const uint8_t MAX_CONSECUTIVE_DROPS = 10;
 
 void Zone::dump_config() const {
-  ESP_LOGCONFIG(TAG, "   %s", id == 0U ? "Entry" : "Exit");
+  ESP_LOGCONFIG(TAG, "   Zone %d: lane %d, position %d", id, lane + 1, position);
   ESP_LOGCONFIG(TAG, "     ROI: { width: %d, height: %d, center: %d }", roi->width, roi->height, roi->center);
   ESP_LOGCONFIG(TAG, "     Threshold: { min: %dmm (%d%%), max: %dmm (%d%%), idle: %dmm }", threshold->min,
                 threshold->min_percentage.value_or((threshold->min * 100) / threshold->idle), threshold->max,
                 threshold->max_percentage.value_or((threshold->max * 100) / threshold->idle), threshold->idle);
+  ESP_LOGCONFIG(TAG, "     Quality gate: { drop invalid: %s, sigma fail: %s, min signal: %ukcps, max ambient: %ukcps }",
+                YESNO(quality_gate->drop_invalid), gate_action_name(quality_gate->sigma_fail),
+                (unsigned) quality_gate->min_signal_rate, (unsigned) quality_gate->max_ambient_rate);
+  ESP_LOGCONFIG(TAG, "     Filters:%s", filters.empty() ? " none" : "");
+  for (auto *filter : filters) {
+    filter->dump_config();
+  }
 }
 
-VL53L1_Error Zone::readDistance(TofSensor *distanceSensor) {
+VL53L1_Error Zone::completeDistance(TofSensor *distanceSensor, ROI *next_roi) {
   last_sensor_status = sensor_status;
 
-  auto result = distanceSensor->read_distance(roi, sensor_status);
+  auto result = distanceSensor->complete_measurement(roi, sensor_status, next_roi);
+  return handle_result(result);
+}
+
+VL53L1_Error Zone::handle_result(const optional<Measurement> &result) {
   if (!result.has_value()) {
     return sensor_status;
   }
 
-  last_distance = result.value();
-  samples.insert(samples.begin(), result.value());
-  if (samples.size() > max_samples) {
-    samples.pop_back();
-  };
-  min_distance = *std::min_element(samples.begin(), samples.end());
+  auto &measurement = result.value();
+  auto quality = quality_gate->classify(measurement);
+  quality_counts[static_cast<uint8_t>(quality)]++;
+  sample_count++;
 
+  auto action = quality_gate->action(quality);
+  last_dropped = action == GateAction::Drop && consecutive_drops < MAX_CONSECUTIVE_DROPS;
+  if (last_dropped) {
+    consecutive_drops++;
+    ESP_LOGV(TAG, "Dropped %s sample of zone %d: %dmm", sample_quality_name(quality), id, measurement.distance);
+    return sensor_status;
+  }
+  consecutive_drops = 0;
+
+  uint16_t distance = measurement.distance;
+  if (action == GateAction::DownWeight && has_filtered) {
+    distance = (distance + filtered_distance) / 2;
+  }
+  add_sample(distance);
   return sensor_status;
 }
 
+void Zone::add_sample(uint16_t distance) {
+  last_distance = distance;
+  for (auto *filter : filters) {
+    distance = filter->new_value(distance);
+  }
+  filtered_distance = distance;
+  has_filtered = true;
+}
+
+void Zone::reset_samples() {
+  for (auto *filter : filters) {
+    filter->reset();
+  }
+}
+
 /**
  * This sets the ROI for the zone to the given overrides or the standard default.
  * This is needed to do initial calibration of thresholds & ROI.
  */
-void Zone::reset_roi(uint8_t default_center) {
-  roi->width = roi_override->width ?: 6;
-  roi->height = roi_override->height ?: 16;
-  roi->center = roi_override->center ?: default_center;
-  ESP_LOGD(TAG, "%s ROI reset: { width: %d, height: %d, center: %d }", id == 0U ? "Entry" : "Exit", roi->width,
-           roi->height, roi->center);
+void Zone::reset_roi(ROI *target, Orientation orientation, uint8_t positions, uint8_t lanes) const {
+  target->width = roi_override->width ?: 6;
+  target->height = roi_override->height ?: 16;
+  // Centered as if the zones were as wide as they can be
+  ROI widest = *target;
+  widest.width = 16 / positions;
+  place_roi(&widest, orientation, positions, lanes);
+  target->height = widest.height;
+  target->center = roi_override->center ?: widest.center;
+  ESP_LOGD(TAG, "Zone %d ROI reset: { width: %d, height: %d, center: %d }", id, target->width, target->height,
+           target->center);
 }
 
-void Zone::calibrateThreshold(TofSensor *distanceSensor, int number_attempts) {
-  ESP_LOGD(CALIBRATION, "Beginning. zoneId: %d", id);
-  int *zone_distances = new int[number_attempts];
-  int sum = 0;
-  for (int i = 0; i < number_attempts; i++) {
-    this->readDistance(distanceSensor);
-    zone_distances[i] = this->getDistance();
-    sum += zone_distances[i];
-  };
-  threshold->idle = this->getOptimizedValues(zone_distances, sum, number_attempts);
-
+void Zone::set_idle(uint16_t idle) {
+  if (blocked) {
+    // Thresholds given as distances are back to the configured ones
+    threshold->min = calibrated_min;
+    threshold->max = calibrated_max;
+    blocked = false;
+  }
+  threshold->idle = idle;
   if (threshold->max_percentage.has_value()) {
     threshold->max = (threshold->idle * threshold->max_percentage.value()) / 100;
   }
@@ -64,69 +109,74 @@ void Zone::calibrateThreshold(TofSensor *distanceSensor, int number_attempts) {
            threshold->max_percentage.value_or((threshold->max * 100) / threshold->idle));
 }
 
-void Zone::roi_calibration(uint16_t entry_threshold, uint16_t exit_threshold, Orientation orientation) {
+void Zone::set_background(uint16_t background) {
+  if (!blocked) {
+    calibrated_idle = threshold->idle;
+    calibrated_min = threshold->min;
+    calibrated_max = threshold->max;
+    blocked = true;
+  }
+  if (calibrated_idle == 0) {
+    return;
+  }
+  threshold->idle = background;
+  threshold->min = (uint32_t) calibrated_min * background / calibrated_idle;
+  threshold->max = (uint32_t) calibrated_max * background / calibrated_idle;
+  ESP_LOGW(TAG, "Zone %d is blocked, background: %dmm, min: %dmm, max: %dmm", id, threshold->idle, threshold->min,
+           threshold->max);
+}
+
+bool Zone::check_unblocked() {
+  if (!blocked || filtered_distance <= threshold->idle + (calibrated_idle - threshold->idle) / 2) {
+    return false;
+  }
+  blocked = false;
+  threshold->idle = calibrated_idle;
+  threshold->min = calibrated_min;
+  threshold->max = calibrated_max;
+  ESP_LOGI(TAG, "Zone %d is clear again, back to idle: %dmm, min: %dmm, max: %dmm", id, threshold->idle,
+           threshold->min, threshold->max);
+  return true;
+}
+
+void Zone::roi_calibration(ROI *target, uint16_t idle_distance, Orientation orientation, uint8_t positions,
+                           uint8_t lanes) const {
   // the value of the average distance is used for computing the optimal size of the ROI and consequently also the
-  // center of the two zones
-  int function_of_the_distance = 16 * (1 - (0.15 * 2) / (0.34 * (min(entry_threshold, exit_threshold) / 1000)));
-  int ROI_size = min(8, max(4, function_of_the_distance));
-  this->roi->width = this->roi_override->width ?: ROI_size;
-  this->roi->height = this->roi_override->height ?: ROI_size * 2;
+  // center of the zones
+  int function_of_the_distance = 16 * (1 - (0.15 * 2) / (0.34 * (idle_distance / 1000)));
+  int ROI_size = std::min(8, std::max(4, function_of_the_distance));
+  target->width = this->roi_override->width ?: ROI_size;
+  target->height = this->roi_override->height ?: ROI_size * 2;
   if (this->roi_override->center) {
-    this->roi->center = this->roi_override->center;
+    target->center = this->roi_override->center;
   } else {
-    // now we set the position of the center of the two zones
-    if (orientation == Parallel) {
-      switch (this->roi->width) {
-        case 4:
-          this->roi->center = this->id == 0U ? 150 : 247;
-          break;
-        case 5:
-        case 6:
-          this->roi->center = this->id == 0U ? 159 : 239;
-          break;
-        case 7:
-        case 8:
-          this->roi->center = this->id == 0U ? 167 : 231;
-          break;
-      }
-    } else {
-      switch (this->roi->width) {
-        case 4:
-          this->roi->center = this->id == 0U ? 193 : 58;
-          break;
-        case 5:
-        case 6:
-          this->roi->center = this->id == 0U ? 194 : 59;
-          break;
-        case 7:
-        case 8:
-          this->roi->center = this->id == 0U ? 195 : 60;
-          break;
-      }
-    }
+    place_roi(target, orientation, positions, lanes);
   }
-  ESP_LOGI(CALIBRATION, "Calibrated ROI for zone. zoneId: %d, width: %d, height: %d, center: %d", id, roi->width,
-           roi->height, roi->center);
+  ESP_LOGI(CALIBRATION, "Calibrated ROI for zone. zoneId: %d, width: %d, height: %d, center: %d", id, target->width,
+           target->height, target->center);
 }
 
-int Zone::getOptimizedValues(int *values, int sum, int size) {
-  int sum_squared = 0;
-  int variance = 0;
-  int sd = 0;
-  int avg = sum / size;
-
-  for (int i = 0; i < size; i++) {
-    sum_squared = sum_squared + (values[i] * values[i]);
-    App.feed_wdt();
+void Zone::place_roi(ROI *target, Orientation orientation, uint8_t positions, uint8_t lanes) const {
+  // Along the walking direction, the zones are spread evenly, the outer ones at the edges of the array.
+  // Odd widths are placed like the next even one, wider ones like the widest which fits.
+  int along = std::min<int>((target->width + 1) & ~1, 16 / positions);
+  int offset = positions > 1 ? this->position * (16 - along) / (positions - 1) : 0;
+  // Across it, each lane has an equal share of the array
+  int across = 16 / lanes;
+  int lane_start = this->lane * across;
+  int column, row;
+  if (orientation == Parallel) {
+    column = along / 2 + offset;
+    row = lane_start + (across - 1) / 2;
+    target->height = std::min<int>(target->height, across);
+  } else {
+    row = (along - 1) / 2 + offset;
+    column = lane_start + across / 2;
   }
-  variance = sum_squared / size - (avg * avg);
-  sd = sqrt(variance);
-  ESP_LOGD(CALIBRATION, "Zone AVG: %d", avg);
-  ESP_LOGD(CALIBRATION, "Zone SD: %d", sd);
-  return avg - sd;
+  target->center = ROI::center_at(column, row);
 }
 
 uint16_t Zone::getDistance() const { return this->last_distance; }
-uint16_t Zone::getMinDistance() const { return this->min_distance; }
+uint16_t Zone::getFilteredDistance() const { return this->filtered_distance; }
 }  // namespace roode
 }  // namespace esphome
\ No newline at end of file
@@ -4,11 +4,13 @@
 #include "esphome/core/application.h"
 #include "esphome/core/log.h"
 #include "esphome/core/optional.h"
-#include "../vl53l1x/vl53l1x.h"
+#include "../tof_sensor/tof_sensor.h"
 #include "orientation.h"
+#include "filters.h"
+#include "quality.h"
 
-using TofSensor = esphome::vl53l1x::VL53L1X;
-using esphome::vl53l1x::ROI;
+using esphome::tof_sensor::ROI;
+using esphome::tof_sensor::TofSensor;
 
 static const char *const TAG = "Zone";
 static const char *const CALIBRATION = "Zone calibration";
@@ -25,32 +27,81 @@ struct Threshold {
   void set_min_percentage(uint8_t min) { this->min_percentage = min; }
   void set_max(uint16_t max) { this->max = max; }
   void set_max_percentage(uint8_t max) { this->max_percentage = max; }
+  /** How much closer than the idle distance someone has to be to count, with the max threshold for that idle */
+  uint16_t detection_margin(uint16_t idle) const {
+    if (max_percentage.has_value()) {
+      return idle * (100 - max_percentage.value()) / 100;
+    }
+    return idle > max ? idle - max : 0;
+  }
 };
 
 class Zone {
  public:
-  explicit Zone(uint8_t id) : id{id} {};
+  explicit Zone(uint8_t id, uint8_t lane = 0, uint8_t position = 0) : id{id}, lane{lane}, position{position} {};
   void dump_config() const;
-  VL53L1_Error readDistance(TofSensor *distanceSensor);
-  void reset_roi(uint8_t default_center);
-  void calibrateThreshold(TofSensor *distanceSensor, int number_attempts);
-  void roi_calibration(uint16_t entry_threshold, uint16_t exit_threshold, Orientation orientation);
+  /** Completes a measurement started with TofSensor::start_measurement for this zone's ROI */
+  VL53L1_Error completeDistance(TofSensor *distanceSensor, ROI *next_roi = nullptr);
+  /** Sets the target to the overrides or the default size, at the zone's place in the layout */
+  void reset_roi(ROI *target, Orientation orientation, uint8_t positions, uint8_t lanes) const;
+  /** Sets the target to the ROI which fits the zones' smallest idle distance best, unless overridden */
+  void roi_calibration(ROI *target, uint16_t idle_distance, Orientation orientation, uint8_t positions,
+                       uint8_t lanes) const;
+  /** Sets the calibrated idle distance and the thresholds which are relative to it */
+  void set_idle(uint16_t idle);
+  /**
+   * Takes this distance as the zone's background instead of the calibrated idle distance, e.g. for an object left
+   * in the zone, scaling the thresholds along with it.
+   */
+  void set_background(uint16_t background);
+  /** Whether the zone reads against a background set by set_background */
+  bool is_blocked() const { return blocked; }
+  /** Restores the calibrated thresholds once a blocked zone reads halfway back to its idle distance */
+  bool check_unblocked();
   const uint8_t id;
+  /** Side by side lanes of zones, each tracked separately */
+  const uint8_t lane;
+  /** Place in the lane along the walking direction, 0 for the entry zone */
+  uint8_t position;
   uint16_t getDistance() const;
-  uint16_t getMinDistance() const;
+  /** The last distance after the filter chain, which is what path tracking compares to the thresholds */
+  uint16_t getFilteredDistance() const;
+  /** Adds a distance as if it was read, used to replay traces */
+  void add_sample(uint16_t distance);
+  void reset_samples();
+  /** Number of successful reads, used to report the achieved sampling rate */
+  uint32_t get_sample_count() const { return sample_count; }
+  /** Number of successful reads of each SampleQuality, since boot */
+  uint32_t get_quality_count(SampleQuality quality) const { return quality_counts[static_cast<uint8_t>(quality)]; }
+  /** Whether the quality gate dropped the last successful read, which left the distances unchanged */
+  bool was_dropped() const { return last_dropped; }
   ROI *roi = new ROI();
   ROI *roi_override = new ROI();
   Threshold *threshold = new Threshold();
-  void set_max_samples(uint8_t max) { max_samples = max; };
+  QualityGate *quality_gate = new QualityGate();
+  /** Appends a stage to the filter chain. Without any, the measured distance is used as is. */
+  void add_filter(DistanceFilter *filter) { filters.push_back(filter); }
 
  protected:
-  int getOptimizedValues(int *values, int sum, int size);
+  /** Centers the target at the zone's place, spreading the zones of a lane over the SPAD array */
+  void place_roi(ROI *target, Orientation orientation, uint8_t positions, uint8_t lanes) const;
+  VL53L1_Error handle_result(const optional<Measurement> &result);
   VL53L1_Error last_sensor_status = VL53L1_ERROR_NONE;
   VL53L1_Error sensor_status = VL53L1_ERROR_NONE;
   uint16_t last_distance;
-  uint16_t min_distance;
-  std::vector<uint16_t> samples;
-  uint8_t max_samples;
+  uint16_t filtered_distance;
+  bool has_filtered{false};
+  std::vector<DistanceFilter *> filters;
+  uint32_t sample_count{0};
+  uint32_t quality_counts[SAMPLE_QUALITIES]{};
+  bool last_dropped{false};
+  /** Samples dropped in a row, which are used anyway once there are too many */
+  uint8_t consecutive_drops{0};
+  bool blocked{false};
+  /** The thresholds before the zone was blocked */
+  uint16_t calibrated_idle{0};
+  uint16_t calibrated_min{0};
+  uint16_t calibrated_max{0};
 };
 }  // namespace roode
 }  // namespace esphome
@@ -0,0 +1,28 @@
+from typing import Dict
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.const import CONF_ID
+
+DEPENDENCIES = ["roode"]
+
+roode_benchmark_ns = cg.esphome_ns.namespace("roode_benchmark")
+RoodeBenchmark = roode_benchmark_ns.class_("RoodeBenchmark", cg.Component)
+
+CONF_EXIT_WHEN_DONE = "exit_when_done"
+CONF_SAMPLES = "samples"
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(RoodeBenchmark),
+        cv.Optional(CONF_SAMPLES, default=100000): cv.int_range(min=1000),
+        cv.Optional(CONF_EXIT_WHEN_DONE, default=False): cv.boolean,
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+
+async def to_code(config: Dict):
+    benchmark = cg.new_Pvariable(config[CONF_ID])
+    await cg.register_component(benchmark, config)
+
+    cg.add(benchmark.set_samples(config[CONF_SAMPLES]))
+    cg.add(benchmark.set_exit_when_done(config[CONF_EXIT_WHEN_DONE]))
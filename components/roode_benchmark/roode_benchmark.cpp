@@ -0,0 +1,275 @@
+#include "roode_benchmark.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace esphome {
+namespace roode_benchmark {
+using roode::ExponentialMovingAverageFilter;
+using roode::HampelFilter;
+using roode::IdleEstimator;
+using roode::MedianFilter;
+using roode::MinFilter;
+using roode::PathTracker;
+using roode::Roode;
+
+static const uint8_t WINDOWS[] = {1, 4, 16, 64};
+static const uint16_t IDLE_DISTANCE = 2200;
+static const uint16_t PERSON_DISTANCE = 450;
+/** Reads per zone for one person to cross both zones, each zone is occupied for half of them */
+static const uint32_t CROSSING_READS = 20;
+/** Reads per estimate, like a calibration with the default number of samples */
+static const int CALIBRATION_READS = 20;
+
+/** A fast, deterministic source of noise (xorshift32), so every run measures the same distances */
+static uint32_t next_random(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/** Noise of up to ±15mm around the distance */
+static uint16_t noisy(uint16_t distance, uint32_t &state) { return distance + (next_random(state) % 31) - 15; }
+
+/** Whether the zone read first (or second) by a crossing is occupied at this read of the crossing */
+static bool is_occupied(bool first, uint32_t read) {
+  uint32_t start = first ? 4 : 8;
+  return read >= start && read < start + CROSSING_READS / 2 - 2;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+VL53L1_Error StubTofSensor::start_measurement(ROI *roi) {
+  if (this->ranging && this->last_roi != nullptr && *roi == *this->last_roi) {
+    // Already in flight
+    return VL53L1_ERROR_NONE;
+  }
+  if (this->ranging) {
+    // Stop ranging to change the ROI
+    this->i2c_transactions++;
+  }
+  if (this->last_roi == nullptr || *roi != *this->last_roi) {
+    this->i2c_transactions++;
+  }
+  this->last_roi = roi;
+  // Start ranging
+  this->i2c_transactions++;
+  this->ranging = true;
+  this->ranging_starts++;
+  this->pending_polls = 1;
+  return VL53L1_ERROR_NONE;
+}
+
+bool StubTofSensor::is_data_ready(VL53L1_Error &error) {
+  error = VL53L1_ERROR_NONE;
+  // Polling the interrupt status
+  this->i2c_transactions++;
+  if (this->pending_polls > 0) {
+    this->pending_polls--;
+    return false;
+  }
+  return true;
+}
+
+optional<Measurement> StubTofSensor::complete_measurement(ROI *roi, VL53L1_Error &error, ROI *next_roi) {
+  error = VL53L1_ERROR_NONE;
+  // Reading the result, then clearing the interrupt (which also stops ranging when not continuous)
+  this->i2c_transactions += 2;
+  if (this->continuous) {
+    if (next_roi != nullptr && *next_roi != *roi) {
+      this->i2c_transactions++;
+      this->last_roi = next_roi;
+    }
+  } else {
+    this->ranging = false;
+  }
+  uint32_t index = this->reads++;
+  if (!this->scene) {
+    return Measurement{noisy(IDLE_DISTANCE, this->rng_state)};
+  }
+  // Roode alternates zones, starting with the entry zone
+  bool entry_zone = index % 2 == 0;
+  uint32_t read = (index / 2) % CROSSING_READS;
+  // Entries first cross the exit zone, see PathTracker
+  bool entering = (index / 2 / CROSSING_READS) % 2 == 0;
+  uint16_t distance = is_occupied(entering != entry_zone, read) ? PERSON_DISTANCE : IDLE_DISTANCE;
+  return Measurement{noisy(distance, this->rng_state)};
+}
+
+void RoodeBenchmark::dump_config() {
+  ESP_LOGCONFIG(TAG, "Roode benchmark:");
+  ESP_LOGCONFIG(TAG, "  Samples per case: %u", (unsigned) this->samples);
+  ESP_LOGCONFIG(TAG, "  Exit when done: %s", YESNO(this->exit_when_done));
+}
+
+void RoodeBenchmark::setup() {
+  ESP_LOGI(TAG, "Running benchmarks with %u samples each", (unsigned) this->samples);
+  for (auto window : WINDOWS) {
+    this->benchmark_filter("min", window, new MinFilter(window));
+    this->benchmark_filter("median", window, new MedianFilter(window));
+    if (window >= 3) {
+      this->benchmark_filter("hampel", window, new HampelFilter(window, 3.0f));
+    }
+  }
+  this->benchmark_filter("exponential_moving_average", 1, new ExponentialMovingAverageFilter(0.3f));
+  this->benchmark_path_tracking();
+  this->benchmark_calibration(false);
+  this->benchmark_calibration(true);
+  this->benchmark_end_to_end(true);
+  this->benchmark_end_to_end(false);
+  ESP_LOGI(TAG, "Benchmarks finished");
+
+  if (this->exit_when_done) {
+    fflush(stdout);
+#ifdef USE_HOST
+    exit(0);
+#else
+    ESP_LOGW(TAG, "Exiting is only supported on the host platform");
+#endif
+  }
+}
+
+void RoodeBenchmark::report(const char *benchmark, const char *variant, uint32_t operations, double seconds,
+                            const std::string &extra) {
+  printf("{\"benchmark\":\"%s\",\"variant\":\"%s\",\"operations\":%u,\"seconds\":%.6f,\"ns_per_op\":%.1f,"
+         "\"ops_per_s\":%.0f%s}\n",
+         benchmark, variant, (unsigned) operations, seconds, seconds * 1e9 / operations, operations / seconds,
+         extra.c_str());
+  fflush(stdout);
+}
+
+void RoodeBenchmark::benchmark_filter(const char *name, uint8_t window, DistanceFilter *filter) {
+  // A zone with only this filter, so the time per sample is that of Zone::add_sample with it
+  roode::Zone zone(0);
+  zone.add_filter(filter);
+
+  // Distances are generated up front, the filters should not be timed together with the noise
+  static const uint16_t INPUTS = 1024;
+  uint16_t distances[INPUTS];
+  uint32_t state = 1;
+  for (uint16_t i = 0; i < INPUTS; i++) {
+    distances[i] = is_occupied(true, i % CROSSING_READS) ? noisy(PERSON_DISTANCE, state) : noisy(IDLE_DISTANCE, state);
+  }
+
+  uint32_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < this->samples; i++) {
+    zone.add_sample(distances[i % INPUTS]);
+    sum += zone.getFilteredDistance();
+  }
+  auto seconds = seconds_since(start);
+  this->sink = this->sink + sum;
+
+  char extra[24];
+  snprintf(extra, sizeof(extra), ",\"window\":%u", window);
+  this->report("zone_filter", name, this->samples, seconds, extra);
+  delete filter;
+}
+
+void RoodeBenchmark::benchmark_path_tracking() {
+  PathTracker tracker;
+  int entries = 0;
+  int exits = 0;
+  // Both zones are updated with every read of a crossing, like Roode does by alternating them
+  uint32_t updates = 0;
+  uint32_t crossings = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (updates < this->samples) {
+    bool entering = crossings % 2 == 0;
+    for (uint32_t read = 0; read < CROSSING_READS; read++) {
+      for (uint8_t position : {0, 1}) {
+        // The entry zone is the left one at position 0, unless the direction is inverted
+        bool entry_zone = position == 0;
+        int delta = tracker.update(position, is_occupied(entering != entry_zone, read) ? SOMEONE : NOBODY);
+        if (delta > 0) {
+          entries++;
+        } else if (delta < 0) {
+          exits++;
+        }
+      }
+    }
+    updates += CROSSING_READS * 2;
+    crossings++;
+  }
+  auto seconds = seconds_since(start);
+
+  char extra[96];
+  snprintf(extra, sizeof(extra), ",\"crossings\":%u,\"entries\":%d,\"exits\":%d,\"expected_entries\":%u",
+           (unsigned) crossings, entries, exits, (unsigned) (crossings + 1) / 2);
+  this->report("path_tracking", "crossings", updates, seconds, extra);
+}
+
+void RoodeBenchmark::benchmark_calibration(bool reject_outliers) {
+  IdleEstimator estimator;
+  estimator.set_reject_outliers(reject_outliers);
+  uint32_t state = 1;
+  uint32_t estimates = 0;
+  double error = 0;
+  int rejected = 0;
+  int restarts = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < this->samples; i++) {
+    // Someone walks through one in 20 reads
+    bool outlier = next_random(state) % 20 == 0;
+    estimator.add(noisy(outlier ? PERSON_DISTANCE : IDLE_DISTANCE, state));
+    if (estimator.get_rejected() >= CALIBRATION_READS) {
+      // Like Roode, measure again when the estimate started from outliers
+      restarts++;
+      estimator.reset();
+    } else if (estimator.get_count() >= CALIBRATION_READS) {
+      error += abs(estimator.mean() - IDLE_DISTANCE);
+      rejected += estimator.get_rejected();
+      estimates++;
+      this->sink = this->sink + estimator.idle();
+      estimator.reset();
+    }
+  }
+  auto seconds = seconds_since(start);
+
+  char extra[128];
+  snprintf(extra, sizeof(extra), ",\"estimates\":%u,\"mean_error_mm\":%.1f,\"rejected\":%d,\"restarts\":%d",
+           (unsigned) estimates, estimates > 0 ? error / estimates : 0.0, rejected, restarts);
+  this->report("calibration", reject_outliers ? "reject_outliers" : "all_reads", this->samples, seconds, extra);
+}
+
+void RoodeBenchmark::benchmark_end_to_end(bool continuous) {
+  auto *sensor = new StubTofSensor();
+  sensor->set_continuous(continuous);
+  auto *roode = new Roode();
+  roode->set_tof_sensor(sensor);
+  for (auto *zone : {roode->entry, roode->exit}) {
+    zone->threshold->set_min_percentage(0);
+    zone->threshold->set_max_percentage(85);
+    zone->add_filter(new MinFilter(2));
+  }
+  roode->setup();
+  // Calibration is not timed, it only runs on boot
+  while (roode->is_calibrating()) {
+    roode->loop();
+  }
+
+  sensor->start_scene();
+  sensor->pop_i2c_transactions();
+  auto starts = sensor->get_ranging_starts();
+  auto counted = [roode]() { return roode->entry->get_sample_count() + roode->exit->get_sample_count(); };
+  auto initial = counted();
+  uint32_t loops = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (counted() - initial < this->samples) {
+    roode->loop();
+    loops++;
+  }
+  auto seconds = seconds_since(start);
+
+  char extra[96];
+  snprintf(extra, sizeof(extra), ",\"loops\":%u,\"ranging_starts\":%u,\"i2c_per_read\":%.2f", (unsigned) loops,
+           (unsigned) (sensor->get_ranging_starts() - starts), (double) sensor->pop_i2c_transactions() / this->samples);
+  this->report("end_to_end", continuous ? "continuous" : "start_stop", this->samples, seconds, extra);
+}
+
+}  // namespace roode_benchmark
+}  // namespace esphome
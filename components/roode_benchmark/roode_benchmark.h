@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "esphome/core/component.h"
+#include "esphome/core/log.h"
+#include "../roode/roode.h"
+#include "../tof_sensor/tof_sensor.h"
+
+namespace esphome {
+namespace roode_benchmark {
+static const char *const TAG = "Roode benchmark";
+
+using roode::DistanceFilter;
+using tof_sensor::Measurement;
+using tof_sensor::RangingMode;
+using tof_sensor::ROI;
+
+/**
+ * A sensor which ranges without taking any time, so the pipeline is timed without waiting for the measurements.
+ * Once the scene is started, people cross the zones every `period` reads, first entering and then leaving.
+ *
+ * Ranging is modelled on the VL53L1X: continuously, the next zone's ROI is programmed with each result and its
+ * measurement is ready on the first poll. Otherwise each measurement starts ranging again, which takes one poll
+ * more. The I2C transactions the VL53L1X would make for this are counted.
+ */
+class StubTofSensor : public tof_sensor::TofSensor {
+ public:
+  VL53L1_Error start_measurement(ROI *roi) override;
+  bool is_data_ready(VL53L1_Error &error) override;
+  optional<Measurement> complete_measurement(ROI *roi, VL53L1_Error &error, ROI *next_roi) override;
+  void set_ranging_mode(const RangingMode *mode) override { this->ranging_mode = mode; }
+  uint32_t pop_i2c_transactions() override {
+    uint32_t transactions = this->i2c_transactions;
+    this->i2c_transactions = 0;
+    return transactions;
+  }
+  void set_continuous(bool continuous) { this->continuous = continuous; }
+  uint32_t get_ranging_starts() const { return this->ranging_starts; }
+  /** Starts the crossings with the next read, which Roode takes of the entry zone */
+  void start_scene() {
+    this->scene = true;
+    this->reads = 0;
+  }
+
+ protected:
+  bool scene{false};
+  uint32_t reads{0};
+  bool continuous{true};
+  bool ranging{false};
+  ROI *last_roi{nullptr};
+  /** Polls until the measurement of a restarted ranging is ready */
+  uint8_t pending_polls{0};
+  uint32_t ranging_starts{0};
+  uint32_t i2c_transactions{0};
+  /** State of the xorshift32 generator of the noise, see next_random */
+  uint32_t rng_state{1};
+};
+
+/**
+ * Times the stages of counting on the machine it runs on, most usefully the host platform.
+ * Each result is printed to stdout as one line of JSON, so runs can be compared by a script.
+ */
+class RoodeBenchmark : public Component {
+ public:
+  void setup() override;
+  void dump_config() override;
+  float get_setup_priority() const override { return setup_priority::LATE; }
+
+  void set_samples(uint32_t samples) { this->samples = samples; }
+  void set_exit_when_done(bool exit) { this->exit_when_done = exit; }
+
+ protected:
+  /** Distances through a single filter of the zone's chain */
+  void benchmark_filter(const char *name, uint8_t window, DistanceFilter *filter);
+  /** Occupancy changes of both zones, as many crossings as fit in the samples */
+  void benchmark_path_tracking();
+  /** Idle distance estimation of the calibration, with & without outlier rejection */
+  void benchmark_calibration(bool reject_outliers);
+  /** Roode's loop, from starting a measurement to path tracking, with a sensor which ranges without taking time */
+  void benchmark_end_to_end(bool continuous);
+  /** Prints one result. `extra` is appended to the JSON object, e.g. `,"window":4`. */
+  void report(const char *benchmark, const char *variant, uint32_t operations, double seconds,
+              const std::string &extra = "");
+
+  uint32_t samples{100000};
+  bool exit_when_done{false};
+  /** Results are added up here, so the compiler cannot drop the work which computes them */
+  volatile uint32_t sink{0};
+};
+
+}  // namespace roode_benchmark
+}  // namespace esphome
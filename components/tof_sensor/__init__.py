@@ -0,0 +1,17 @@
+import esphome.codegen as cg
+
+tof_sensor_ns = cg.esphome_ns.namespace("tof_sensor")
+TofSensor = tof_sensor_ns.class_("TofSensor", cg.Component)
+
+CONF_AUTO = "auto"
+
+Ranging = tof_sensor_ns.namespace("Ranging")
+RANGING_MODES = {
+    CONF_AUTO: CONF_AUTO,
+    "shortest": Ranging.Shortest,
+    "short": Ranging.Short,
+    "medium": Ranging.Medium,
+    "long": Ranging.Long,
+    "longer": Ranging.Longer,
+    "longest": Ranging.Longest,
+}
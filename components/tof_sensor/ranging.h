@@ -1,22 +1,28 @@
 #pragma once
-#include "VL53L1X_ULD.h"
+#include <cstdint>
 
 namespace esphome {
-namespace vl53l1x {
+namespace tof_sensor {
+
+/** The distance mode of the sensor. Values match the VL53L1X ULD's EDistanceMode. */
+enum class DistanceMode : uint8_t { Short = 1, Long = 2 };
 
 struct RangingMode {
-  explicit RangingMode(const char * name, uint16_t timing_budget, EDistanceMode mode = EDistanceMode::Long)
+  explicit RangingMode(const char *name, uint16_t timing_budget, DistanceMode mode = DistanceMode::Long)
       : name{name}, timing_budget{timing_budget}, mode{mode} {}
+  /** A mode which waits longer between measurements than the timing budget requires */
+  RangingMode(const char *name, uint16_t timing_budget, uint16_t delay_between_measurements, DistanceMode mode)
+      : name{name}, timing_budget{timing_budget}, delay_between_measurements{delay_between_measurements}, mode{mode} {}
 
   const char *name;
   uint16_t const timing_budget;
   uint16_t const delay_between_measurements = timing_budget + 5;
-  EDistanceMode const mode;
+  DistanceMode const mode;
 };
 
 namespace Ranging {
 // NOLINTBEGIN(cert-err58-cpp)
-__attribute__((unused)) static const RangingMode *Shortest = new RangingMode("Shortest", 15, Short);
+__attribute__((unused)) static const RangingMode *Shortest = new RangingMode("Shortest", 15, DistanceMode::Short);
 __attribute__((unused)) static const RangingMode *Short = new RangingMode("Short", 20);
 __attribute__((unused)) static const RangingMode *Medium = new RangingMode("Medium", 33);
 __attribute__((unused)) static const RangingMode *Long = new RangingMode("Long", 50);
@@ -25,5 +31,5 @@ __attribute__((unused)) static const RangingMode *Longest = new RangingMode("Lon
 // NOLINTEND(cert-err58-cpp)
 }  // namespace Ranging
 
-}  // namespace vl53l1x
+}  // namespace tof_sensor
 }  // namespace esphome
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+
+namespace esphome {
+namespace tof_sensor {
+
+struct ROI {
+  uint8_t width;
+  uint8_t height;
+  uint8_t center;
+  void set_width(uint8_t val) { this->width = val; }
+  void set_height(uint8_t val) { this->height = val; }
+  void set_center(uint8_t val) { this->center = val; }
+
+  /**
+   * Column & row of the center SPAD in the 16x16 array, see the table in the README.
+   * SPADs from 128 on cover rows 0-7, the others rows 8-15 counting down.
+   */
+  int column() const { return center >= 128 ? (center - 128) / 8 : 15 - center / 8; }
+  int row() const { return center >= 128 ? (center - 128) % 8 : 15 - center % 8; }
+  /** First column & row the ROI covers. The center of an even size is right of the middle in columns, left in rows. */
+  int left() const { return column() - width / 2; }
+  int top() const { return row() - (height - 1) / 2; }
+  static uint8_t center_at(int column, int row) {
+    return row < 8 ? 128 + column * 8 + row : (15 - column) * 8 + 15 - row;
+  }
+
+  bool operator==(const ROI &rhs) const { return width == rhs.width && height == rhs.height && center == rhs.center; }
+  bool operator!=(const ROI &rhs) const { return !(rhs == *this); }
+};
+
+}  // namespace tof_sensor
+}  // namespace esphome
@@ -0,0 +1,26 @@
+#include "tof_sensor.h"
+#include "esphome/core/application.h"
+#include "esphome/core/hal.h"
+
+namespace esphome {
+namespace tof_sensor {
+
+optional<Measurement> TofSensor::read_distance(ROI *roi, VL53L1_Error &error, ROI *next_roi) {
+  error = this->start_measurement(roi);
+  if (error != VL53L1_ERROR_NONE) {
+    return {};
+  }
+
+  while (!this->is_data_ready(error)) {
+    if (error != VL53L1_ERROR_NONE) {
+      return {};
+    }
+    delay(1);
+    App.feed_wdt();
+  }
+
+  return this->complete_measurement(roi, error, next_roi);
+}
+
+}  // namespace tof_sensor
+}  // namespace esphome
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+
+#include "esphome/core/component.h"
+#include "esphome/core/optional.h"
+#include "ranging.h"
+#include "roi.h"
+
+#ifndef VL53L1_ERROR_NONE
+// Same as the VL53L1X ULD's error type, so sensors don't need the driver to report errors.
+typedef int8_t VL53L1_Error;
+#define VL53L1_ERROR_NONE ((VL53L1_Error) 0)
+#endif
+
+namespace esphome {
+namespace tof_sensor {
+
+/** Range status of a measurement, with the same values as the ULD's VL53L1X_GetRangeStatus */
+enum class RangeStatus : uint8_t {
+  Valid = 0,
+  /** The measurement's standard deviation is above its limit, the distance is noisy */
+  SigmaFail = 1,
+  /** Too little signal returned to be sure of the distance */
+  SignalFail = 2,
+  /** The phase is out of its valid limits, e.g. nothing is within range */
+  OutOfBounds = 4,
+  /** Valid, but not checked for wrap-around, which the first measurement after ranging starts cannot be */
+  NoWrapAroundCheck = 6,
+  /** The target is beyond the ranging period, so it appears closer than it is */
+  WrapAround = 7,
+  /** Any other failure, e.g. of the hardware */
+  Other = 255,
+};
+
+/** A measured distance, with the quality the sensor reported for it */
+struct Measurement {
+  uint16_t distance;
+  RangeStatus status{RangeStatus::Valid};
+  /** Return signal rate in kcps, 0 when the sensor does not report it */
+  uint32_t signal_rate{0};
+  /** Ambient light rate in kcps, 0 when the sensor does not report it */
+  uint32_t ambient_rate{0};
+};
+
+/**
+ * A Time-of-Flight (ToF) sensor, which measures the distance within a region of interest (ROI).
+ * This is what Roode counts with, implemented by the VL53L1X and the simulator.
+ */
+class TofSensor : public Component {
+ public:
+  /**
+   * Read a distance for the given ROI, blocking until the measurement is ready.
+   * `next_roi` is a hint of the ROI which will be read next, so it can already be measured.
+   */
+  optional<Measurement> read_distance(ROI *roi, VL53L1_Error &error, ROI *next_roi = nullptr);
+
+  /**
+   * The non-blocking phases of read_distance.
+   * Start a measurement for the ROI, poll until it is ready, then complete it to get the distance & its quality.
+   */
+  virtual VL53L1_Error start_measurement(ROI *roi) = 0;
+  /** Whether the measurement is ready. Sets error when the check failed or the measurement timed out. */
+  virtual bool is_data_ready(VL53L1_Error &error) = 0;
+  virtual optional<Measurement> complete_measurement(ROI *roi, VL53L1_Error &error, ROI *next_roi) = 0;
+
+  virtual void set_ranging_mode(const RangingMode *mode) = 0;
+  const RangingMode *get_ranging_mode() const { return this->ranging_mode; }
+  optional<const RangingMode *> get_ranging_mode_override() { return this->ranging_mode_override; }
+  void set_ranging_mode_override(const RangingMode *mode) { this->ranging_mode_override = {mode}; }
+
+  /**
+   * Makes measurements only become ready once their distance is within [low, high], so the sensor itself waits for
+   * someone to come close, without the MCU reading every measurement. They don't time out meanwhile.
+   * Returns false when the sensor cannot do this.
+   */
+  virtual bool set_distance_window(uint16_t low, uint16_t high) { return false; }
+  /** Makes every measurement ready again */
+  virtual void clear_distance_window() {}
+
+  /** The largest time between a measurement being ready and it being read, since the last call */
+  virtual uint32_t pop_max_data_ready_latency() { return 0; }
+  /** Number of I2C transactions since the last call, when the sensor counts them */
+  virtual uint32_t pop_i2c_transactions() { return 0; }
+
+ protected:
+  const RangingMode *ranging_mode{};
+  /** Mode from user config, which can be get/set independently of current mode */
+  optional<const RangingMode *> ranging_mode_override{};
+};
+
+}  // namespace tof_sensor
+}  // namespace esphome
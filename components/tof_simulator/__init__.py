@@ -0,0 +1,99 @@
+from typing import Dict
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.const import CONF_HEIGHT, CONF_ID
+
+from ..tof_sensor import TofSensor, tof_sensor_ns
+from ..vl53l1x import distance_as_mm
+
+AUTO_LOAD = ["tof_sensor"]
+
+tof_simulator_ns = cg.esphome_ns.namespace("tof_simulator")
+TofSimulator = tof_simulator_ns.class_("TofSimulator", TofSensor)
+RangeStatus = tof_sensor_ns.enum("RangeStatus", is_class=True)
+RANGE_STATUSES = {
+    "sigma_fail": RangeStatus.SigmaFail,
+    "signal_fail": RangeStatus.SignalFail,
+    "out_of_bounds": RangeStatus.OutOfBounds,
+    "wrap_around": RangeStatus.WrapAround,
+}
+
+CONF_AMBIENT_RATE = "ambient_rate"
+CONF_AT = "at"
+CONF_CONTINUOUS = "continuous_ranging"
+CONF_CROSSINGS = "crossings"
+CONF_DIRECTION = "direction"
+CONF_ERROR_RATE = "error_rate"
+CONF_IDLE_DISTANCE = "idle_distance"
+CONF_NOISE = "noise"
+CONF_ORIENTATION = "orientation"
+CONF_RANGE_STATUS = "range_status"
+CONF_REPEAT = "repeat"
+CONF_SIGNAL_RATE = "signal_rate"
+CONF_SPEED = "speed"
+
+CROSSING_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_AT): cv.positive_time_period_milliseconds,
+        cv.Required(CONF_DIRECTION): cv.one_of("entry", "exit", lower=True),
+        cv.Optional(CONF_HEIGHT, default="1.75m"): cv.All(distance_as_mm, cv.uint16_t),
+        # meters per second
+        cv.Optional(CONF_SPEED, default=1.4): cv.positive_float,
+    }
+)
+
+def validate_status_rates(config: Dict):
+    if sum(config.values()) > 1:
+        raise cv.Invalid("The range status rates must not add up to more than 100%")
+    return config
+
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(TofSimulator),
+        cv.Optional(CONF_IDLE_DISTANCE, default="2200mm"): cv.All(
+            distance_as_mm, cv.uint16_t
+        ),
+        cv.Optional(CONF_NOISE, default="10mm"): cv.All(distance_as_mm, cv.uint16_t),
+        cv.Optional(CONF_ERROR_RATE, default="0%"): cv.percentage,
+        cv.Optional(CONF_RANGE_STATUS, default={}): cv.All(
+            cv.Schema({cv.Optional(status): cv.percentage for status in RANGE_STATUSES}),
+            validate_status_rates,
+        ),
+        # kcps, 0 to not report them
+        cv.Optional(CONF_SIGNAL_RATE, default=0): cv.uint32_t,
+        cv.Optional(CONF_AMBIENT_RATE, default=0): cv.uint32_t,
+        cv.Optional(CONF_CONTINUOUS, default=True): cv.boolean,
+        cv.Optional(CONF_ORIENTATION, default="parallel"): cv.one_of(
+            "parallel", "perpendicular", lower=True
+        ),
+        cv.Optional(CONF_REPEAT): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_CROSSINGS, default=[]): cv.ensure_list(CROSSING_SCHEMA),
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+
+async def to_code(config: Dict):
+    sim = cg.new_Pvariable(config[CONF_ID])
+    await cg.register_component(sim, config)
+
+    cg.add(sim.set_idle_distance(config[CONF_IDLE_DISTANCE]))
+    cg.add(sim.set_noise(config[CONF_NOISE]))
+    cg.add(sim.set_error_rate(config[CONF_ERROR_RATE]))
+    for status, rate in config[CONF_RANGE_STATUS].items():
+        cg.add(sim.add_status_rate(RANGE_STATUSES[status], rate))
+    cg.add(sim.set_signal_rate(config[CONF_SIGNAL_RATE]))
+    cg.add(sim.set_ambient_rate(config[CONF_AMBIENT_RATE]))
+    cg.add(sim.set_continuous(config[CONF_CONTINUOUS]))
+    cg.add(sim.set_perpendicular(config[CONF_ORIENTATION] == "perpendicular"))
+    if CONF_REPEAT in config:
+        cg.add(sim.set_repeat(config[CONF_REPEAT]))
+    for crossing in config[CONF_CROSSINGS]:
+        cg.add(
+            sim.add_crossing(
+                crossing[CONF_AT].total_milliseconds,
+                crossing[CONF_HEIGHT],
+                crossing[CONF_SPEED],
+                crossing[CONF_DIRECTION] == "entry",
+            )
+        )
@@ -0,0 +1,184 @@
+#include "tof_simulator.h"
+#include <cmath>
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+
+namespace esphome {
+namespace tof_simulator {
+
+/** tan() of half the 27° field of view */
+static const float HALF_FOV_TAN = 0.2401f;
+/** The depth of a person's body along the walking direction, in m */
+static const float BODY_DEPTH = 0.3f;
+/** Same code the driver returns when I2C communication fails */
+static const VL53L1_Error SIMULATED_ERROR = -13;
+/** How much noisier a measurement with a sigma failure is, at least this many mm */
+static const float SIGMA_FAIL_NOISE = 50;
+
+static const char *status_name(RangeStatus status) {
+  switch (status) {
+    case RangeStatus::SigmaFail:
+      return "sigma fail";
+    case RangeStatus::SignalFail:
+      return "signal fail";
+    case RangeStatus::OutOfBounds:
+      return "out of bounds";
+    case RangeStatus::WrapAround:
+      return "wrap-around";
+    default:
+      return "other";
+  }
+}
+
+void TofSimulator::dump_config() {
+  ESP_LOGCONFIG(TAG, "ToF Simulator:");
+  if (this->ranging_mode != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Ranging: %s", this->ranging_mode->name);
+  }
+  ESP_LOGCONFIG(TAG, "  Idle distance: %dmm", this->idle_distance);
+  ESP_LOGCONFIG(TAG, "  Noise: %dmm", this->noise);
+  ESP_LOGCONFIG(TAG, "  Error rate: %.1f%%", this->error_rate * 100);
+  for (auto &status_rate : this->status_rates) {
+    ESP_LOGCONFIG(TAG, "  Range status %s: %.1f%%", status_name(status_rate.status), status_rate.rate * 100);
+  }
+  if (this->signal_rate > 0 || this->ambient_rate > 0) {
+    ESP_LOGCONFIG(TAG, "  Signal rate: %ukcps, ambient rate: %ukcps", (unsigned) this->signal_rate,
+                  (unsigned) this->ambient_rate);
+  }
+  ESP_LOGCONFIG(TAG, "  Continuous: %s", YESNO(this->continuous));
+  ESP_LOGCONFIG(TAG, "  Crossings: %d", (int) this->crossings.size());
+  if (this->repeat > 0) {
+    ESP_LOGCONFIG(TAG, "  Repeat: every %ums", (unsigned) this->repeat);
+  }
+}
+
+void TofSimulator::setup() { this->scene_start = millis(); }
+
+void TofSimulator::set_ranging_mode(const RangingMode *mode) {
+  this->ranging_mode = mode;
+  ESP_LOGI(TAG, "Set ranging mode: %s", mode->name);
+}
+
+VL53L1_Error TofSimulator::start_measurement(ROI *roi) {
+  this->measurement_start = millis();
+  this->measurement_roi = roi;
+  this->first_after_start = this->continued_roi == nullptr || *roi != *this->continued_roi;
+  return VL53L1_ERROR_NONE;
+}
+
+bool TofSimulator::is_data_ready(VL53L1_Error &error) {
+  error = VL53L1_ERROR_NONE;
+  uint16_t budget = this->ranging_mode != nullptr ? this->ranging_mode->timing_budget : 50;
+  if ((millis() - this->measurement_start) < budget) {
+    return false;
+  }
+  if (this->window && this->measurement_roi != nullptr) {
+    // Like the sensor, keep ranging until a measurement is within the window
+    uint16_t distance = this->distance_at(this->measurement_roi, this->scene_time());
+    if (distance < this->window_low || distance > this->window_high) {
+      this->measurement_start = millis();
+      return false;
+    }
+  }
+  return true;
+}
+
+optional<Measurement> TofSimulator::complete_measurement(ROI *roi, VL53L1_Error &error, ROI *next_roi) {
+  this->continued_roi = nullptr;
+  if (this->error_rate > 0 && random_float() < this->error_rate) {
+    error = SIMULATED_ERROR;
+    return {};
+  }
+  error = VL53L1_ERROR_NONE;
+  if (this->continuous) {
+    this->continued_roi = next_roi != nullptr ? next_roi : roi;
+  }
+
+  float distance = this->distance_at(roi, this->scene_time());
+  auto status = this->draw_status();
+  switch (status) {
+    case RangeStatus::Valid:
+    case RangeStatus::NoWrapAroundCheck:
+      distance += this->gaussian() * this->noise;
+      break;
+    case RangeStatus::SigmaFail:
+      distance += this->gaussian() * std::max(4.0f * this->noise, SIGMA_FAIL_NOISE);
+      break;
+    default:
+      // Far off, mostly closer, e.g. a target beyond range wrapping around to a close one
+      distance *= random_float();
+      break;
+  }
+  Measurement measurement{static_cast<uint16_t>(std::max(0.0f, distance))};
+  measurement.status = status;
+  measurement.signal_rate = this->signal_rate;
+  measurement.ambient_rate = this->ambient_rate;
+  return measurement;
+}
+
+RangeStatus TofSimulator::draw_status() const {
+  if (!this->status_rates.empty()) {
+    float draw = random_float();
+    for (auto &status_rate : this->status_rates) {
+      if (draw < status_rate.rate) {
+        return status_rate.status;
+      }
+      draw -= status_rate.rate;
+    }
+  }
+  return this->first_after_start ? RangeStatus::NoWrapAroundCheck : RangeStatus::Valid;
+}
+
+uint32_t TofSimulator::scene_time() const {
+  uint32_t time = millis() - this->scene_start;
+  if (this->repeat > 0) {
+    time %= this->repeat;
+  }
+  return time;
+}
+
+uint16_t TofSimulator::distance_at(const ROI *roi, uint32_t time) const {
+  // Position of the ROI in the SPAD array
+  int position = this->perpendicular ? roi->row() : roi->column();
+  int size = this->perpendicular ? roi->height : roi->width;
+  // ROI bounds as a fraction of the field of view, -0.5 to 0.5
+  float low = std::max(0.0f, position - size / 2.0f) / 16 - 0.5f;
+  float high = std::min(16.0f, position + size / 2.0f) / 16 - 0.5f;
+
+  uint16_t distance = this->idle_distance;
+  for (auto &crossing : this->crossings) {
+    if (time < crossing.at || crossing.height >= this->idle_distance) {
+      continue;
+    }
+    uint16_t head_distance = this->idle_distance - crossing.height;
+    // Half width of the field of view at the height of the head, in m
+    float half_width = head_distance / 1000.0f * HALF_FOV_TAN;
+    float walked = crossing.speed * (time - crossing.at) / 1000.0f;
+    float start = half_width + BODY_DEPTH;
+    if (walked > 2 * start) {
+      continue;  // Already through
+    }
+    float center = crossing.entry ? start - walked : walked - start;
+
+    float roi_low = low * 2 * half_width;
+    float roi_high = high * 2 * half_width;
+    float overlap = std::min(roi_high, center + BODY_DEPTH / 2) - std::max(roi_low, center - BODY_DEPTH / 2);
+    float coverage = std::max(0.0f, overlap) / (roi_high - roi_low);
+
+    // Mix in the floor while the person only partially covers the ROI
+    float seen = coverage >= 0.5f ? 1.0f : std::max(0.0f, coverage - 0.15f) / 0.35f;
+    auto crossing_distance = static_cast<uint16_t>(this->idle_distance - crossing.height * seen);
+    distance = std::min(distance, crossing_distance);
+  }
+  return distance;
+}
+
+float TofSimulator::gaussian() const {
+  // Box-Muller transform
+  float u1 = std::max(random_float(), 1e-6f);
+  float u2 = random_float();
+  return std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+}
+
+}  // namespace tof_simulator
+}  // namespace esphome
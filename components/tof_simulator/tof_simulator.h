@@ -0,0 +1,109 @@
+#pragma once
+#include <vector>
+
+#include "esphome/core/component.h"
+#include "esphome/core/log.h"
+#include "../tof_sensor/tof_sensor.h"
+
+namespace esphome {
+namespace tof_simulator {
+static const char *const TAG = "ToF Simulator";
+
+using tof_sensor::Measurement;
+using tof_sensor::RangeStatus;
+using tof_sensor::RangingMode;
+using tof_sensor::ROI;
+
+/** A person walking through the field of view */
+struct Crossing {
+  /** Milliseconds after boot or after the start of the repeated scene */
+  uint32_t at;
+  /** Height of the person in mm */
+  uint16_t height;
+  /** Walking speed in m/s */
+  float speed;
+  /** Whether the person walks in the direction Roode counts as an entry (when not inverted) */
+  bool entry;
+};
+
+/** A failed range status, reported for this share of the measurements */
+struct StatusRate {
+  RangeStatus status;
+  float rate;
+};
+
+/**
+ * A simulated Time-of-Flight sensor, which measures distances in a scripted scene of people crossing
+ * below it. This allows running the whole Roode pipeline without hardware, e.g. on the host platform.
+ */
+class TofSimulator : public tof_sensor::TofSensor {
+ public:
+  void setup() override;
+  void dump_config() override;
+  float get_setup_priority() const override { return setup_priority::DATA; };
+
+  VL53L1_Error start_measurement(ROI *roi) override;
+  bool is_data_ready(VL53L1_Error &error) override;
+  optional<Measurement> complete_measurement(ROI *roi, VL53L1_Error &error, ROI *next_roi) override;
+  void set_ranging_mode(const RangingMode *mode) override;
+  bool set_distance_window(uint16_t low, uint16_t high) override {
+    this->window_low = low;
+    this->window_high = high;
+    this->window = true;
+    return true;
+  }
+  void clear_distance_window() override { this->window = false; }
+
+  void set_idle_distance(uint16_t val) { this->idle_distance = val; }
+  void set_noise(uint16_t val) { this->noise = val; }
+  void set_error_rate(float val) { this->error_rate = val; }
+  void add_status_rate(RangeStatus status, float rate) { this->status_rates.push_back(StatusRate{status, rate}); }
+  void set_signal_rate(uint32_t val) { this->signal_rate = val; }
+  void set_ambient_rate(uint32_t val) { this->ambient_rate = val; }
+  void set_continuous(bool val) { this->continuous = val; }
+  void set_perpendicular(bool val) { this->perpendicular = val; }
+  void set_repeat(uint32_t val) { this->repeat = val; }
+  void add_crossing(uint32_t at, uint16_t height, float speed, bool entry) {
+    this->crossings.push_back(Crossing{at, height, speed, entry});
+  }
+
+ protected:
+  /** The noiseless distance seen by the ROI at the given time since the scene started */
+  uint16_t distance_at(const ROI *roi, uint32_t time) const;
+  /** Time since the scene (re)started */
+  uint32_t scene_time() const;
+  float gaussian() const;
+  /** Draws a failed range status by their rates, or returns the one of a successful measurement */
+  RangeStatus draw_status() const;
+
+  uint16_t idle_distance{2200};
+  uint16_t noise{0};
+  float error_rate{0};
+  std::vector<StatusRate> status_rates{};
+  /** Reported with each measurement, in kcps. 0 like a sensor which does not report them. */
+  uint32_t signal_rate{0};
+  uint32_t ambient_rate{0};
+  /**
+   * Like the VL53L1X, ranging continues with the ROI programmed with the previous result. Otherwise it starts for
+   * every measurement, whose status is then NoWrapAroundCheck.
+   */
+  bool continuous{true};
+  /** The ROI ranging continues with, nullptr when it starts again with the next measurement */
+  const ROI *continued_roi{nullptr};
+  bool first_after_start{true};
+  /** Whether people walk along the rows of the SPAD array instead of the columns */
+  bool perpendicular{false};
+  /** Restart the scene after this many ms, 0 to play it once */
+  uint32_t repeat{0};
+  std::vector<Crossing> crossings{};
+  uint32_t scene_start{0};
+  uint32_t measurement_start{0};
+  /** The ROI being measured, for the distance window */
+  const ROI *measurement_roi{nullptr};
+  bool window{false};
+  uint16_t window_low{0};
+  uint16_t window_high{0};
+};
+
+}  // namespace tof_simulator
+}  // namespace esphome
@@ -4,8 +4,10 @@ from esphome.components import i2c
 from esphome.core import CORE
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
 from esphome.const import (
     CONF_FREQUENCY,
+    CONF_ADDRESS,
     CONF_ID,
     CONF_I2C,
     CONF_I2C_ID,
@@ -15,33 +17,24 @@ from esphome.const import (
     CONF_TIMEOUT,
 )
 import esphome.pins as pins
+from ..tof_sensor import CONF_AUTO, RANGING_MODES, TofSensor
 
 _LOGGER = logging.getLogger(__name__)
 
 DEPENDENCIES = ["i2c"]
-AUTO_LOAD = ["i2c"]
-MULTI_CONF = False  # TODO enable when we support multiple addresses
+AUTO_LOAD = ["i2c", "tof_sensor"]
+MULTI_CONF = True
 
 vl53l1x_ns = cg.esphome_ns.namespace("vl53l1x")
-VL53L1X = vl53l1x_ns.class_("VL53L1X", cg.Component)
+VL53L1X = vl53l1x_ns.class_("VL53L1X", TofSensor, i2c.I2CDevice)
 
-CONF_AUTO = "auto"
 CONF_CALIBRATION = "calibration"
+CONF_CONTINUOUS = "continuous_ranging"
+CONF_FAST_MODE_PLUS = "fast_mode_plus"
 CONF_RANGING_MODE = "ranging"
 CONF_XSHUT = "xshut"
 CONF_XTALK = "crosstalk"
 
-Ranging = vl53l1x_ns.namespace("Ranging")
-RANGING_MODES = {
-    CONF_AUTO: CONF_AUTO,
-    "shortest": Ranging.Shortest,
-    "short": Ranging.Short,
-    "medium": Ranging.Medium,
-    "long": Ranging.Long,
-    "longer": Ranging.Longer,
-    "longest": Ranging.Longest,
-}
-
 int16_t = cv.int_range(min=-32768, max=32768)  # signed
 
 
@@ -80,6 +73,8 @@ CONFIG_SCHEMA = (
             cv.Optional(
                 CONF_TIMEOUT, default="2s"
             ): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_CONTINUOUS, default=True): cv.boolean,
+            cv.Optional(CONF_FAST_MODE_PLUS, default=False): cv.boolean,
             cv.Optional(CONF_PINS, default={}): NullableSchema(
                 {
                     cv.Optional(CONF_XSHUT): pins.gpio_output_pin_schema,
@@ -107,6 +102,42 @@ CONFIG_SCHEMA = (
 )
 
 
+def validate_multiple_sensors(config: Dict):
+    """
+    All sensors boot at the same address, so with more than one on a bus each needs
+    its own XSHUT pin to be brought up alone and moved to its configured address.
+    """
+    sensors = fv.full_config.get().get("vl53l1x", [])
+    if len(sensors) < 2:
+        return config
+    if CONF_XSHUT not in config[CONF_PINS]:
+        raise cv.Invalid(
+            "An xshut pin is required for each sensor when using multiple sensors",
+            path=[CONF_PINS],
+        )
+    addresses = [(other[CONF_I2C_ID], other[CONF_ADDRESS]) for other in sensors]
+    if addresses.count((config[CONF_I2C_ID], config[CONF_ADDRESS])) > 1:
+        raise cv.Invalid(
+            f"Address 0x{config[CONF_ADDRESS]:02X} is used by multiple sensors on the same I2C bus",
+            path=[CONF_ADDRESS],
+        )
+    # The bus runs at one frequency, which every sensor on it has to agree on
+    on_bus = [
+        other for other in sensors if other[CONF_I2C_ID] == config[CONF_I2C_ID]
+    ]
+    if any(
+        other[CONF_FAST_MODE_PLUS] != config[CONF_FAST_MODE_PLUS] for other in on_bus
+    ):
+        raise cv.Invalid(
+            "fast_mode_plus has to be the same for all sensors on the same I2C bus",
+            path=[CONF_FAST_MODE_PLUS],
+        )
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = validate_multiple_sensors
+
+
 async def to_code(config: Dict):
     cg.add_library("rneurink", "1.2.3", "VL53L1X_ULD")
 
@@ -114,25 +145,46 @@ async def to_code(config: Dict):
     await cg.register_component(vl53l1x, config)
     await i2c.register_i2c_device(vl53l1x, config)
 
-    # If i2c frequency has not been explicitly set, then increase it to our recommended
+    # The frequency is set once per bus, by its first sensor
     i2c_id = config[CONF_I2C_ID]
+    first = next(
+        sensor for sensor in CORE.config["vl53l1x"] if sensor[CONF_I2C_ID] == i2c_id
+    )
+    if first[CONF_ID].id == config[CONF_ID].id:
+        await setup_bus(i2c_id, config[CONF_FAST_MODE_PLUS])
+
+    cg.add(vl53l1x.set_timeout(config[CONF_TIMEOUT]))
+    cg.add(vl53l1x.set_continuous(config[CONF_CONTINUOUS]))
+    await setup_hardware(vl53l1x, config)
+    await setup_calibration(vl53l1x, config[CONF_CALIBRATION])
+
+
+async def setup_bus(i2c_id, fast_mode_plus: bool):
+    # If i2c frequency has not been explicitly set, then increase it to our recommended
     i2c_config = next(
         entry for entry in CORE.config[CONF_I2C] if entry[CONF_ID] == i2c_id
     )
     frequency = i2c_config[CONF_FREQUENCY]
+    if fast_mode_plus and not CORE.is_esp32:
+        _LOGGER.warning(
+            "Fast-mode Plus (1MHz) is only supported on ESP32, using 400kHz instead"
+        )
     if frequency == 50000:  # default
         i2c_var = await cg.get_variable(i2c_id)
-        cg.add(i2c_var.set_frequency(400000))
+        # Every device on the bus needs to support Fast-mode Plus
+        fast = fast_mode_plus and CORE.is_esp32
+        cg.add(i2c_var.set_frequency(1000000 if fast else 400000))
+    elif frequency > 1000000:
+        _LOGGER.warning(
+            "The VL53L1X supports I2C frequencies up to 1MHz. Currently: %dkHz",
+            frequency / 1000,
+        )
     elif frequency < 400000:
         _LOGGER.warning(
             "Recommended I2C frequency for VL53L1X is 400kHz. Currently: %dkHz",
             frequency / 1000,
         )
 
-    cg.add(vl53l1x.set_timeout(config[CONF_TIMEOUT]))
-    await setup_hardware(vl53l1x, config)
-    await setup_calibration(vl53l1x, config[CONF_CALIBRATION])
-
 
 async def setup_hardware(vl53l1x: cg.Pvariable, config: Dict):
     pins = config[CONF_PINS]
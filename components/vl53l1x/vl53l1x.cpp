@@ -1,7 +1,46 @@
 #include "vl53l1x.h"
+#include <cstring>
 
 namespace esphome {
 namespace vl53l1x {
+// Registers the wrapper accesses directly, instead of through the ULD, to combine & skip transactions
+static const uint16_t ROI_CONFIG__USER_ROI_CENTRE_SPAD = 0x007F;
+static const uint16_t SYSTEM__INTERRUPT_CONFIG_GPIO = 0x0046;
+static const uint16_t SYSTEM__THRESH_HIGH = 0x0072;
+static const uint16_t SYSTEM__INTERRUPT_CLEAR = 0x0086;
+static const uint16_t SYSTEM__MODE_START = 0x0087;
+static const uint16_t GPIO_HV_MUX__CTRL = 0x0030;
+static const uint16_t GPIO__TIO_HV_STATUS = 0x0031;
+static const uint16_t RESULT__RANGE_STATUS = 0x0089;
+/** From the range status to the crosstalk corrected signal rate, which covers every result used */
+static const size_t RESULT_SIZE = 17;
+static const uint8_t MODE_START_RANGING = 0x40;
+static const uint8_t MODE_STOP = 0x00;
+static const uint8_t INTERRUPT_CLEAR = 0x01;
+/** Interrupt on a new sample, the default */
+static const uint8_t INTERRUPT_NEW_SAMPLE = 0x20;
+/** Interrupt when the distance is within the thresholds, for any target (like the ULD's IntOnNoTarget) */
+static const uint8_t INTERRUPT_WINDOW_INSIDE = 0x03 | 0x40;
+
+/** Maps the device's range status to the ULD's, like VL53L1X_GetRangeStatus */
+static RangeStatus range_status(uint8_t device_status) {
+  switch (device_status & 0x1F) {
+    case 9:
+      return RangeStatus::Valid;
+    case 19:
+      return RangeStatus::NoWrapAroundCheck;
+    case 6:
+      return RangeStatus::SigmaFail;
+    case 4:
+      return RangeStatus::SignalFail;
+    case 5:
+      return RangeStatus::OutOfBounds;
+    case 7:
+      return RangeStatus::WrapAround;
+    default:
+      return RangeStatus::Other;
+  }
+}
 
 void VL53L1X::dump_config() {
   ESP_LOGCONFIG(TAG, "VL53L1X:");
@@ -9,20 +48,38 @@ void VL53L1X::dump_config() {
   if (this->ranging_mode != nullptr) {
     ESP_LOGCONFIG(TAG, "  Ranging: %s", this->ranging_mode->name);
   }
+  ESP_LOGCONFIG(TAG, "  Continuous: %s", YESNO(this->continuous));
   if (offset.has_value()) {
     ESP_LOGCONFIG(TAG, "  Offset: %dmm", this->offset.value());
   }
   if (xtalk.has_value()) {
     ESP_LOGCONFIG(TAG, "  XTalk: %dcps", this->xtalk.value());
   }
-  LOG_PIN("  Interrupt Pin: ", this->interrupt_pin.value());
-  LOG_PIN("  XShut Pin: ", this->xshut_pin.value());
+  LOG_PIN("  Interrupt Pin: ", this->interrupt_pin.value_or(nullptr));
+  LOG_PIN("  XShut Pin: ", this->xshut_pin.value_or(nullptr));
 }
 
+std::vector<VL53L1X *> VL53L1X::instances;
+bool VL53L1X::instances_reset = false;
+
 void VL53L1X::setup() {
   ESP_LOGD(TAG, "Beginning setup");
 
-  // TODO use xshut_pin, if given, to change address
+  if (!VL53L1X::instances_reset) {
+    // All sensors boot with the same address. Hold every one of them in reset,
+    // so they can be brought up one after another to be given their own address.
+    for (auto *instance : VL53L1X::instances) {
+      if (instance->xshut_pin.has_value()) {
+        instance->xshut_pin.value()->setup();
+        instance->xshut_pin.value()->digital_write(false);
+      }
+    }
+    VL53L1X::instances_reset = true;
+  }
+  if (this->xshut_pin.has_value()) {
+    this->xshut_pin.value()->digital_write(true);
+  }
+
   auto status = this->init();
   if (status != VL53L1_ERROR_NONE) {
     this->mark_failed();
@@ -50,6 +107,14 @@ void VL53L1X::setup() {
     }
   }
 
+  if (this->interrupt_pin.has_value()) {
+    auto *pin = this->interrupt_pin.value();
+    pin->setup();
+    // The default configuration drives GPIO1 active high when a measurement is ready
+    pin->attach_interrupt(&VL53L1X::gpio_intr, this, gpio::INTERRUPT_RISING_EDGE);
+    ESP_LOGD(TAG, "Using interrupt pin to await measurements");
+  }
+
   ESP_LOGI(TAG, "Setup complete");
 }
 
@@ -58,28 +123,55 @@ VL53L1_Error VL53L1X::init() {
 
   VL53L1_Error status;
 
-  // If address is non-default, set and try again.
-  if (address_ != (sensor.GetI2CAddress() >> 1)) {
-    ESP_LOGD(TAG, "Setting different address");
-    status = sensor.SetI2CAddress(address_ << 1);
+  if (this->xshut_pin.has_value()) {
+    // Just out of reset, so the sensor is at the default address and it is the only one there
+    status = wait_for_boot();
+    if (status != VL53L1_ERROR_NONE) {
+      return status;
+    }
+    status = this->change_address();
+    if (status != VL53L1_ERROR_NONE) {
+      return status;
+    }
+  } else {
+    status = this->change_address();
+    if (status != VL53L1_ERROR_NONE) {
+      return status;
+    }
+    status = wait_for_boot();
     if (status != VL53L1_ERROR_NONE) {
-      ESP_LOGE(TAG, "Failed to change address. Error: %d", status);
       return status;
     }
   }
 
-  status = wait_for_boot();
+  ESP_LOGD(TAG, "Found device, initializing...");
+  status = sensor.Init();
   if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Could not initialize device, error code: %d", status);
     return status;
   }
 
-  ESP_LOGD(TAG, "Found device, initializing...");
-  status = sensor.Init();
+  // The polarity does not change, so polling for data only needs to read the status
+  uint8_t mux;
+  status = this->read_registers(GPIO_HV_MUX__CTRL, &mux, 1);
   if (status != VL53L1_ERROR_NONE) {
-    ESP_LOGE(TAG, "Could not initialize device, error code: %d", status);
+    ESP_LOGE(TAG, "Could not read interrupt polarity, error code: %d", status);
     return status;
   }
+  this->interrupt_polarity = (mux & 0x10) == 0 ? 1 : 0;
+  return status;
+}
 
+VL53L1_Error VL53L1X::change_address() {
+  // If address is non-default, set and try again.
+  if (address_ == (sensor.GetI2CAddress() >> 1)) {
+    return VL53L1_ERROR_NONE;
+  }
+  ESP_LOGD(TAG, "Setting different address: 0x%02X", address_);
+  auto status = sensor.SetI2CAddress(address_ << 1);
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Failed to change address. Error: %d", status);
+  }
   return status;
 }
 
@@ -131,9 +223,14 @@ void VL53L1X::set_ranging_mode(const RangingMode *mode) {
     return;
   }
 
-  auto status = this->sensor.SetDistanceMode(mode->mode);
+  // Timing parameters cannot be changed while ranging, it is restarted with the next read
+  if (this->ranging_active) {
+    this->stop_ranging();
+  }
+
+  auto status = this->sensor.SetDistanceMode(static_cast<EDistanceMode>(mode->mode));
   if (status != VL53L1_ERROR_NONE) {
-    ESP_LOGE(TAG, "Could not set distance mode: %d, error code: %d", mode->mode, status);
+    ESP_LOGE(TAG, "Could not set distance mode: %d, error code: %d", static_cast<int>(mode->mode), status);
   }
 
   status = this->sensor.SetTimingBudgetInMs(mode->timing_budget);
@@ -150,67 +247,210 @@ void VL53L1X::set_ranging_mode(const RangingMode *mode) {
   ESP_LOGI(TAG, "Set ranging mode: %s", mode->name);
 }
 
-optional<uint16_t> VL53L1X::read_distance(ROI *roi, VL53L1_Error &status) {
+bool VL53L1X::set_distance_window(uint16_t low, uint16_t high) {
+  // Like VL53L1X_SetDistanceThreshold, it applies from the next time ranging starts
+  if (this->ranging_active) {
+    this->stop_ranging();
+  }
+  // The high threshold is followed by the low one, so both are written at once
+  uint8_t thresholds[4] = {(uint8_t) (high >> 8), (uint8_t) high, (uint8_t) (low >> 8), (uint8_t) low};
+  auto status = this->write_registers(SYSTEM__THRESH_HIGH, thresholds, sizeof(thresholds));
+  if (status == VL53L1_ERROR_NONE) {
+    status = this->write_registers(SYSTEM__INTERRUPT_CONFIG_GPIO, &INTERRUPT_WINDOW_INSIDE, 1);
+  }
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Could not set distance window, error code: %d", status);
+    return false;
+  }
+  this->distance_window = true;
+  ESP_LOGD(TAG, "Set distance window: %d-%dmm", low, high);
+  return true;
+}
+
+void VL53L1X::clear_distance_window() {
+  if (this->ranging_active) {
+    this->stop_ranging();
+  }
+  auto status = this->write_registers(SYSTEM__INTERRUPT_CONFIG_GPIO, &INTERRUPT_NEW_SAMPLE, 1);
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Could not clear distance window, error code: %d", status);
+  }
+  this->distance_window = false;
+}
+
+VL53L1_Error VL53L1X::start_measurement(ROI *roi) {
   if (this->is_failed()) {
     ESP_LOGW(TAG, "Cannot read distance while component is failed");
-    return {};
+    return VL53L1_ERROR_CONTROL_INTERFACE;
   }
 
   ESP_LOGVV(TAG, "Beginning distance read");
+  this->measurement_start = millis();
 
-  if (last_roi == nullptr || *roi != *last_roi) {
-    ESP_LOGVV(TAG, "Setting new ROI: { width: %d, height: %d, center: %d }", roi->width, roi->height, roi->center);
+  if (this->ranging_active && last_roi != nullptr && *roi == *last_roi) {
+    // Already in flight
+    return VL53L1_ERROR_NONE;
+  }
+  // Nothing is in flight for this ROI, so (re)start ranging with it
+  return this->start_ranging(roi);
+}
 
-    status = this->sensor.SetROI(roi->width, roi->height);
-    if (status != VL53L1_ERROR_NONE) {
-      ESP_LOGE(TAG, "Could not set ROI width/height, error code: %d", status);
-      return {};
+bool VL53L1X::is_data_ready(VL53L1_Error &status) {
+  status = VL53L1_ERROR_NONE;
+  if (this->interrupt_pin.has_value()) {
+    // Rely on the ISR instead of polling the sensor over I2C
+    if (this->data_ready) {
+      return true;
     }
-    status = this->sensor.SetROICenter(roi->center);
+  } else {
+    uint8_t gpio_status;
+    status = this->read_registers(GPIO__TIO_HV_STATUS, &gpio_status, 1);
     if (status != VL53L1_ERROR_NONE) {
-      ESP_LOGE(TAG, "Could not set ROI center, error code: %d", status);
-      return {};
+      ESP_LOGE(TAG, "Failed to check if data is ready, error code: %d", status);
+      return false;
+    }
+    if ((gpio_status & 0x01) == this->interrupt_polarity) {
+      return true;
     }
-    last_roi = roi;
   }
 
-  status = this->sensor.StartRanging();
-
-  // Wait for the measurement to be ready
-  // TODO use interrupt_pin, if given, to await data ready instead of polling
-  uint8_t dataReady = false;
-  while (!dataReady) {
-    status = this->sensor.CheckForDataReady(&dataReady);
-    if (status != VL53L1_ERROR_NONE) {
-      ESP_LOGE(TAG, "Failed to check if data is ready, error code: %d", status);
-      return {};
-    }
-    delay(1);
-    App.feed_wdt();
+  if (!this->distance_window && (millis() - this->measurement_start) > this->timeout) {
+    ESP_LOGE(TAG, "Timed out waiting for data ready");
+    // Make the next measurement restart ranging
+    this->stop_ranging();
+    status = VL53L1_ERROR_TIME_OUT;
   }
+  return false;
+}
+
+optional<Measurement> VL53L1X::complete_measurement(ROI *roi, VL53L1_Error &status, ROI *next_roi) {
+  // Consume the interrupt flag before the interrupt is cleared, so the next measurement can set it again
+  this->data_ready = false;
 
-  // Get the results
-  uint16_t distance;
-  status = this->sensor.GetDistanceInMm(&distance);
+  // Get the distance together with its quality, in one read of the result block like VL53L1X_GetResult
+  uint8_t result[RESULT_SIZE];
+  status = this->read_registers(RESULT__RANGE_STATUS, result, RESULT_SIZE);
   if (status != VL53L1_ERROR_NONE) {
     ESP_LOGE(TAG, "Could not get distance, error code: %d", status);
     return {};
   }
+  Measurement measurement{(uint16_t) ((result[13] << 8) | result[14])};
+  measurement.status = range_status(result[0]);
+  // Both rates are in MCPS as 9.7 fixed point, which the ULD approximates to kcps by multiplying with 8
+  measurement.ambient_rate = ((result[7] << 8) | result[8]) * 8;
+  measurement.signal_rate = ((result[15] << 8) | result[16]) * 8;
+  if (this->interrupt_pin.has_value()) {
+    uint32_t latency = micros() - this->data_ready_time;
+    if (latency > this->max_data_ready_latency) {
+      this->max_data_ready_latency = latency;
+    }
+    ESP_LOGVV(TAG, "Read distance %uus after data ready", (unsigned) latency);
+  }
+
+  if (this->continuous) {
+    // Program the next ROI before clearing the interrupt, so the next measurement already ranges with it
+    if (next_roi != nullptr && *next_roi != *roi) {
+      status = this->set_roi(next_roi);
+      if (status != VL53L1_ERROR_NONE) {
+        return {};
+      }
+    }
+  }
 
-  // After reading the results reset the interrupt to be able to take another measurement
-  status = this->sensor.ClearInterrupt();
+  // After reading the results reset the interrupt to be able to take another measurement.
+  // The mode register follows the interrupt clear, so ranging is stopped in the same write.
+  uint8_t clear[2] = {INTERRUPT_CLEAR, MODE_STOP};
+  status = this->write_registers(SYSTEM__INTERRUPT_CLEAR, clear, this->continuous ? 1 : 2);
   if (status != VL53L1_ERROR_NONE) {
     ESP_LOGE(TAG, "Could not clear interrupt, error code: %d", status);
     return {};
   }
-  status = this->sensor.StopRanging();
+  if (!this->continuous) {
+    this->ranging_active = false;
+  }
+
+  ESP_LOGV(TAG, "Finished distance read: %d, status: %d, signal: %ukcps, ambient: %ukcps", measurement.distance,
+           (int) measurement.status, (unsigned) measurement.signal_rate, (unsigned) measurement.ambient_rate);
+  return measurement;
+}
+
+VL53L1_Error VL53L1X::set_roi(ROI *roi) {
+  // The center & size registers are adjacent, so the whole ROI is written at once
+  uint8_t width = std::min<uint8_t>(roi->width, 16);
+  uint8_t height = std::min<uint8_t>(roi->height, 16);
+  uint8_t encoded[2] = {roi->center, (uint8_t) (((height - 1) << 4) | (width - 1))};
+  if (this->roi_programmed && memcmp(encoded, this->programmed_roi, sizeof(encoded)) == 0) {
+    // Another ROI with the same values, e.g. the calibration's copy of a zone's
+    last_roi = roi;
+    return VL53L1_ERROR_NONE;
+  }
+  ESP_LOGVV(TAG, "Setting new ROI: { width: %d, height: %d, center: %d }", roi->width, roi->height, roi->center);
+
+  auto status = this->write_registers(ROI_CONFIG__USER_ROI_CENTRE_SPAD, encoded, sizeof(encoded));
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Could not set ROI, error code: %d", status);
+    this->roi_programmed = false;
+    return status;
+  }
+  memcpy(this->programmed_roi, encoded, sizeof(encoded));
+  this->roi_programmed = true;
+  // Only once it is written, so a failed write is retried with the next measurement
+  last_roi = roi;
+  return status;
+}
+
+VL53L1_Error VL53L1X::start_ranging(ROI *roi) {
+  VL53L1_Error status;
+  if (this->ranging_active) {
+    // The ROI of a measurement in flight cannot be changed, so restart ranging
+    status = this->stop_ranging();
+    if (status != VL53L1_ERROR_NONE) {
+      return status;
+    }
+  }
+
+  if (last_roi == nullptr || *roi != *last_roi) {
+    status = this->set_roi(roi);
+    if (status != VL53L1_ERROR_NONE) {
+      return status;
+    }
+  }
+  last_roi = roi;
+
+  this->data_ready = false;
+  status = this->write_registers(SYSTEM__MODE_START, &MODE_START_RANGING, 1);
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Could not start ranging, error code: %d", status);
+    return status;
+  }
+  this->ranging_active = true;
+  return status;
+}
+
+VL53L1_Error VL53L1X::stop_ranging() {
+  auto status = this->write_registers(SYSTEM__MODE_START, &MODE_STOP, 1);
   if (status != VL53L1_ERROR_NONE) {
     ESP_LOGE(TAG, "Could not stop ranging, error code: %d", status);
-    return {};
+    return status;
   }
+  this->ranging_active = false;
+  return status;
+}
+
+VL53L1_Error VL53L1X::write_registers(uint16_t reg, const uint8_t *data, size_t len) {
+  this->i2c_transactions++;
+  return this->write_register16(reg, data, len) == i2c::ERROR_OK ? VL53L1_ERROR_NONE
+                                                                  : VL53L1_ERROR_CONTROL_INTERFACE;
+}
+
+VL53L1_Error VL53L1X::read_registers(uint16_t reg, uint8_t *data, size_t len) {
+  this->i2c_transactions++;
+  return this->read_register16(reg, data, len) == i2c::ERROR_OK ? VL53L1_ERROR_NONE : VL53L1_ERROR_CONTROL_INTERFACE;
+}
 
-  ESP_LOGV(TAG, "Finished distance read: %d", distance);
-  return {distance};
+void IRAM_ATTR VL53L1X::gpio_intr(VL53L1X *arg) {
+  arg->data_ready_time = micros();
+  arg->data_ready = true;
 }
 
 }  // namespace vl53l1x
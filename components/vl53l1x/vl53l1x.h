@@ -1,5 +1,6 @@
 #pragma once
 #include <math.h>
+#include <vector>
 
 #include "VL53L1X_ULD.h"
 #include "esphome/components/i2c/i2c.h"
@@ -7,50 +8,95 @@
 #include "esphome/core/component.h"
 #include "esphome/core/gpio.h"
 #include "esphome/core/log.h"
-#include "ranging.h"
-#include "roi.h"
+#include "../tof_sensor/tof_sensor.h"
 
 namespace esphome {
 namespace vl53l1x {
 static const char *const TAG = "VL53L1X";
 
+using tof_sensor::Measurement;
+using tof_sensor::RangeStatus;
+using tof_sensor::RangingMode;
+using tof_sensor::ROI;
+
 /**
  * A wrapper for the VL53L1X, Time-of-Flight (ToF), laser-ranging sensor.
  * This stores user calibration info.
  */
-class VL53L1X : public i2c::I2CDevice, public Component {
+class VL53L1X : public i2c::I2CDevice, public tof_sensor::TofSensor {
  public:
+  VL53L1X() { VL53L1X::instances.push_back(this); }
   void setup() override;
   void dump_config() override;
   /** This connects directly to a sensor */
   float get_setup_priority() const override { return setup_priority::DATA; };
 
-  optional<uint16_t> read_distance(ROI *roi, VL53L1_Error &error);
-  void set_ranging_mode(const RangingMode *mode);
+  VL53L1_Error start_measurement(ROI *roi) override;
+  bool is_data_ready(VL53L1_Error &error) override;
+  optional<Measurement> complete_measurement(ROI *roi, VL53L1_Error &error, ROI *next_roi) override;
+  void set_ranging_mode(const RangingMode *mode) override;
+  bool set_distance_window(uint16_t low, uint16_t high) override;
+  void clear_distance_window() override;
 
   void set_xshut_pin(GPIOPin *pin) { this->xshut_pin = pin; }
   void set_interrupt_pin(InternalGPIOPin *pin) { this->interrupt_pin = pin; }
-  optional<const RangingMode *> get_ranging_mode_override() { return this->ranging_mode_override; }
-  void set_ranging_mode_override(const RangingMode *mode) { this->ranging_mode_override = {mode}; }
   void set_offset(int16_t val) { this->offset = val; }
   void set_xtalk(uint16_t val) { this->xtalk = val; }
   void set_timeout(uint16_t val) { this->timeout = val; }
+  void set_continuous(bool val) { this->continuous = val; }
+  uint32_t pop_max_data_ready_latency() override {
+    auto latency = this->max_data_ready_latency;
+    this->max_data_ready_latency = 0;
+    return latency;
+  }
+  uint32_t pop_i2c_transactions() override {
+    auto transactions = this->i2c_transactions;
+    this->i2c_transactions = 0;
+    return transactions;
+  }
 
  protected:
   VL53L1X_ULD sensor;
   optional<GPIOPin *> xshut_pin{};
   optional<InternalGPIOPin *> interrupt_pin{};
-  const RangingMode * ranging_mode{};
-  /** Mode from user config, which can be get/set independently of current mode */
-  optional<const RangingMode *> ranging_mode_override{};
   optional<int16_t> offset{};
   optional<uint16_t> xtalk{};
   uint16_t timeout{};
+  /** Keep the sensor ranging between reads instead of starting & stopping for every sample */
+  bool continuous{true};
+  bool ranging_active{false};
+  /** The ROI programmed for the measurement currently in flight */
   ROI *last_roi{};
+  /** The ROI's register values as last written, to skip writing the same ones again */
+  uint8_t programmed_roi[2]{};
+  bool roi_programmed{false};
+  /** Measurements only become ready within the distance window, so waiting for them never times out */
+  bool distance_window{false};
+  /** Level of GPIO1 when a measurement is ready, read once on setup */
+  uint8_t interrupt_polarity{1};
+  /** Register accesses in the measurement path, which the wrapper makes directly instead of through the ULD */
+  uint32_t i2c_transactions{0};
+  /** Set from the interrupt pin's ISR when a measurement is ready */
+  volatile bool data_ready{false};
+  volatile uint32_t data_ready_time{0};
+  uint32_t max_data_ready_latency{0};
+  uint32_t measurement_start{0};
+
+  static void gpio_intr(VL53L1X *arg);
+  /** Every sensor, so they can all be held in reset before the first one is set up */
+  static std::vector<VL53L1X *> instances;
+  static bool instances_reset;
 
   VL53L1_Error init();
+  VL53L1_Error change_address();
+  VL53L1_Error set_roi(ROI *roi);
+  VL53L1_Error start_ranging(ROI *roi);
+  VL53L1_Error stop_ranging();
   VL53L1_Error wait_for_boot();
   VL53L1_Error get_device_state(uint8_t *device_state);
+  /** Writes consecutive registers in a single transaction */
+  VL53L1_Error write_registers(uint16_t reg, const uint8_t *data, size_t len);
+  VL53L1_Error read_registers(uint16_t reg, uint8_t *data, size_t len);
 };
 
 }  // namespace vl53l1x